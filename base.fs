@@ -1,21 +1,21 @@
 : \ IMMEDIATE   10 WORD DROP ;
-: CR    10 EMIT ;
-: TAB   9 EMIT ;
-: SPACE 32 EMIT ;
+: CR    INLINE 10 EMIT ;
+: TAB   INLINE 9 EMIT ;
+: SPACE INLINE 32 EMIT ;
 : CMP   2DUP > ROT < - ;
 : BIN IMMEDIATE 2 BASE ! ;
 : DEC IMMEDIATE 10 BASE ! ;
 : HEX IMMEDIATE 16 BASE ! ;
 : .     0 .R SPACE ;
 : U.    0 U.R SPACE ;
-: LITERAL IMMEDIATE COMPILE-ONLY    [ ' LIT , ] LIT , , ;
+: LITERAL IMMEDIATE COMPILE-ONLY    POSTPONE LIT , ;
 : ['] IMMEDIATE COMPILE-ONLY    ' POSTPONE LITERAL ;
 : IF IMMEDIATE COMPILE-ONLY     POSTPONE 0BRANCH HERE @ >CTRL 0 , ;
 : THEN IMMEDIATE COMPILE-ONLY   CTRL> HERE @ OVER - /CELLS SWAP ! ; 
 : ELSE IMMEDIATE COMPILE-ONLY 
     POSTPONE BRANCH CTRL> HERE @ 0 , >CTRL HERE @ OVER - /CELLS SWAP ! 
 ; 
-: <=>   2DUP < IF -1 ELSE > IF 1 ELSE 0 THEN THEN ;
+: <=>   2DUP < IF 2DROP -1 ELSE > IF 1 ELSE 0 THEN THEN ;
 : CHAR  32 WORD 1+ C@ ;
 : [CHAR] IMMEDIATE COMPILE-ONLY 32 WORD 1+ C@ POSTPONE LITERAL ;
 : BEGIN IMMEDIATE COMPILE-ONLY HERE @ >CTRL ;
@@ -26,6 +26,16 @@
     POSTPONE BRANCH 2CTRL> SWAP HERE @ - /CELLS , HERE @ OVER - /CELLS SWAP !
 ;
 : RECURSE IMMEDIATE COMPILE-ONLY    LATEST @ DE>CFA , ;
+: DO IMMEDIATE COMPILE-ONLY     POSTPONE (DO) LEAVES @ >CTRL 0 LEAVES ! HERE @ >CTRL ;
+: ?DO IMMEDIATE COMPILE-ONLY    POSTPONE (?DO) LEAVES @ >CTRL HERE @ LEAVES ! 0 , HERE @ >CTRL ;
+: LEAVE IMMEDIATE COMPILE-ONLY  POSTPONE UNLOOP POSTPONE BRANCH HERE @ LEAVES @ , LEAVES ! ;
+\ each LEAVE (and ?DO) branch holds the address of the one before until the loop ends
+: RESOLVE-LEAVES
+    LEAVES @ BEGIN DUP WHILE DUP @ SWAP HERE @ OVER - /CELLS SWAP ! REPEAT DROP
+    CTRL> LEAVES !
+;
+: LOOP IMMEDIATE COMPILE-ONLY   POSTPONE (LOOP) CTRL> HERE @ - /CELLS , RESOLVE-LEAVES ;
+: +LOOP IMMEDIATE COMPILE-ONLY  POSTPONE (+LOOP) CTRL> HERE @ - /CELLS , RESOLVE-LEAVES ;
 : ( IMMEDIATE
     DEC 1 >R
     BEGIN
@@ -39,17 +49,18 @@
                 R1-
             THEN
         THEN
-        DROP
+        0< IF           \ end of input, still inside
+            R> DROP 0 >R
+        THEN
     REPEAT
     R> DROP
 ;
 
 
 
-: ALIGNED   3 + 3 INVERT AND ;
+: ALIGNED   INLINE [ 1 CELLS 1- ] LITERAL + [ 1 CELLS 1- INVERT ] LITERAL AND ;
 : ALIGN     HERE @ ALIGNED HERE ! ;
-: C,        HERE @ C! 1 HERE +! ;                    
-: ." IMMEDIATE COMPILE-ONLY
+: S" IMMEDIATE COMPILE-ONLY
     [ ' LITSTRING ] LITERAL ,
     HERE @ 0 ,
     BEGIN
@@ -60,22 +71,24 @@
     REPEAT
     2DROP
     ALIGN
-    [ ' TELL ] LITERAL ,
 ;
+: ." IMMEDIATE COMPILE-ONLY     POSTPONE S" [ ' TELL ] LITERAL , ;
 : VARIABLE  CREATE 1 CELLS ALLOT ;
 : CONSTANT  CREATE DFA>CFA DOCON SWAP !  , ;
-: EXIT IMMEDIATE COMPILE-ONLY   0 , ;
+: EXIT IMMEDIATE COMPILE-ONLY   EXIT, ;
 DEC 32 CONSTANT BL
-: COUNT DUP 1+ SWAP C@ ;
+: COUNT INLINE DUP 1+ SWAP C@ ;
 : CTELL COUNT TELL ;
+: INCLUDE   BL WORD COUNT INCLUDED ;
+: SAVESYSTEM    BL WORD COUNT SAVE-IMAGE ;
 : SPACES    BEGIN DUP 0> WHILE SPACE 1- REPEAT DROP ;
-: @++  ( addr -- addr+1 n )     DUP @ SWAP 1 CELLS + SWAP ;
-: C@++ ( caddr -- caddr+1 n )   DUP C@ SWAP 1+ SWAP ;
+: @++  ( addr -- addr+1 n )     INLINE DUP @ SWAP 1 CELLS + SWAP ;
+: C@++ ( caddr -- caddr+1 n )   INLINE DUP C@ SWAP 1+ SWAP ;
 : DUMP ( caddr len -- ) HEX >R BEGIN R@ 0> WHILE C@++ 3 U.R R> 1- >R REPEAT CR R> 2DROP DEC ;
 : VALUE     CREATE DFA>CFA DOVAL SWAP ! , ; 
 : TO IMMEDIATE
     BL WORD FIND DE>DFA
-    DUP DFA>CFA @ DOVAL <> IF ." Not a value!" CR EXIT THEN \ FIXME make this sane
+    DUP DFA>CFA @ DOVAL <> IF ." Not a value!" CR DROP EXIT THEN \ FIXME make this sane
     STATE S_COMPILE = IF
         POSTPONE LIT    
         ,
@@ -88,29 +101,33 @@ DEC 32 CONSTANT BL
 
 
 \ decompiler!
-: XT-NAME   9 CELLS - COUNT F_HIDDEN F_IMMED F_COMPONLY OR OR INVERT AND ;
-: CCOUNT    DUP 1 CELLS + SWAP @ ;
+: XT-NAME   1 CELLS + DFA>DE DE>NAME COUNT F_HIDDEN F_IMMED F_COMPONLY OR OR INVERT AND ;
+: CCOUNT    INLINE DUP 1 CELLS + SWAP @ ;
 : '."'      46 EMIT 34 EMIT SPACE ;
 : 'S"'      [ CHAR S ] LITERAL EMIT 34 EMIT SPACE ;
 : SEE
     BL WORD DUP FIND
     DUP 0= IF ." (not found)" CR 2DROP EXIT THEN \ bail out if the word is not found
-    DUP DE>CFA @ DOCOL <> IF ." (native)" CR 2DROP EXIT THEN \ bail if its not a colon def
+    DUP DE>CFA DUP @ DOCOL <> SWAP JIT? 0= AND
+        IF ." (native)" CR 2DROP EXIT THEN  \ bail if its not a colon def
     ." :" SPACE SWAP COUNT TELL SPACE \ ": FOO "
     DUP 1 CELLS + C@
     DUP F_IMMED AND 0<> IF ." IMMEDIATE" SPACE THEN
     DUP F_COMPONLY AND 0<> IF ." COMPILE-ONLY" SPACE THEN
+    OVER INLINE? IF ." INLINE" SPACE THEN
+    OVER DE>CFA JIT? IF ." ( JIT )" SPACE THEN
+    OVER STACK-EFFECT IF DROP SWAP ." ( " . ." -- " . ." )" SPACE ELSE DROP 2DROP THEN
     DROP CR
     DE>DFA DUP >R 
     BEGIN
         DUP @ DUP 2 PICK R@ < OR
     WHILE
-        DUP [ ' LIT ] LITERAL = IF           
+        DUP XT-ARG 1 = IF                   \ LIT, and superinstructions starting with it
             TAB 40 EMIT SPACE XT-NAME TELL SPACE 41 EMIT 3 SPACES
             1 CELLS +
             DUP @ . CR
         ELSE
-            DUP [ ' LITSTRING ] LITERAL = IF
+            DUP XT-ARG 3 = IF               \ LITSTRING
                 TAB 40 EMIT SPACE XT-NAME TELL SPACE
                 1 CELLS +
                 DUP @ 0 .R SPACE 41 EMIT 
@@ -118,18 +135,12 @@ DEC 32 CONSTANT BL
                 DUP ALIGNED /CELLS 3 SPACES 40 EMIT SPACE . ." cells " 41 EMIT CR
                 ALIGNED +
             ELSE
-                DUP [ ' 0BRANCH ] LITERAL = IF
+                DUP XT-ARG 4 = IF           \ (TAIL), and what it jumps to
                     TAB XT-NAME TELL SPACE
                     1 CELLS +
-                    DUP @ DUP 0> IF
-                        2DUP CELLS + 
-                        DUP R@ > IF R> SWAP >R THEN
-                        DROP
-                    THEN
-                    DROP
-                    DUP @ . CR
+                    DUP @ XT-NAME TELL CR
                 ELSE
-                    DUP [ ' BRANCH ] LITERAL = IF
+                    DUP XT-ARG 2 = IF       \ BRANCH, 0BRANCH, and superinstructions ending with them
                         TAB XT-NAME TELL SPACE
                         1 CELLS +
                         DUP @ DUP 0> IF
@@ -0,0 +1,12 @@
+\ Arithmetic loop microbenchmark for the inner interpreter.
+\ Usage: cat base.fs bench/arith.fs | ./froth
+DEC
+: ARITH-STEP    3 4 + 5 * 2 - 7 AND 1 OR DROP ;
+: ARITH ( n -- )
+    BEGIN
+        ARITH-STEP
+        1- DUP 0=
+    UNTIL
+    DROP
+;
+5000000 ARITH
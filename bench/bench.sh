@@ -0,0 +1,124 @@
+#!/bin/sh
+# The benchmark suite: runs each workload several times and prints one line for each,
+#   name runs median_ms min_ms ops ops_per_s maxrss_kb
+# where ops_per_s leaves out the time it takes froth just to start and load base.fs (the
+# median of the "startup" line), and maxrss_kb is the most any run used (see froth -t).
+# Lines starting with # are comments, so the output can be saved and used as a baseline.
+#
+# Usage: bench/bench.sh [-n runs] [-c baseline] [-t percent] [workload ...]
+#   -n runs       how many times to run each workload (default 5)
+#   -c baseline   compare with the output of an earlier run: adds its median_ms, the change
+#                 in percent, and "ok", "faster" or "REGRESSION" to each line, and exits 1
+#                 if any workload's median is more than -t percent (default 10) slower
+# make bench runs it, comparing with bench/baseline.txt if there is one, and
+# make bench-baseline saves a new one.
+
+FROTH=${FROTH:-./froth}
+RUNS=5
+BASELINE=
+TOLERANCE=10
+
+while getopts n:c:t: opt; do
+    case $opt in
+        n)  RUNS=$OPTARG ;;
+        c)  BASELINE=$OPTARG ;;
+        t)  TOLERANCE=$OPTARG ;;
+        *)  sed -n '9,14p' "$0" >&2; exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+# name  file  ops  Forth to run after it, if any
+SUITE="
+fib     bench/calls.fs      29860703
+arith   bench/arith.fs      5000000
+loops   bench/loops.fs      20000000    20000 DO-LOOPS DROP
+sieve   bench/sieve.fs      500
+sort    bench/sort.fs       4995000
+parse   bench/parse.fs      8500000
+lookup  bench/lookup.fs     3200000
+report  bench/report.fs     200000
+compile COMPILE             10000
+"
+WORKLOADS=${*:-$(echo "$SUITE" | awk 'NF { print $1 }')}
+
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+# compile: that many definitions, each with a comment, a branch and a loop, for the outer
+# interpreter, dictionary and compiler to get through
+awk 'BEGIN {
+    print ": W0 ( n -- n ) 1+ ;"
+    for (i = 1; i < 10000; i++)
+        printf ": W%d ( n -- n ) DUP 0 < IF 1+ ELSE 1- THEN 3 + %d * 10 0 DO I + LOOP W%d ;\n", i, i % 97, i - 1
+}' > "$TMP/compile.fs"
+: > "$TMP/empty.fs"
+
+run () {  # file [trailer] -> prints wall_ms maxrss_kb
+    if [ -n "$2" ]; then echo "$2" > "$TMP/trailer.fs"; else : > "$TMP/trailer.fs"; fi
+    start=$(date +%s%N)
+    $FROTH -t base.fs "$1" "$TMP/trailer.fs" </dev/null >/dev/null 2>"$TMP/stderr" \
+        || { echo "$FROTH failed running $1" >&2; exit 1; }
+    end=$(date +%s%N)
+    echo "$(( (end - start) / 1000000 )) $(awk '$1 == "user_ms" { rss = $6 } END { print rss + 0 }' "$TMP/stderr")"
+}
+
+measure () {  # name file ops [trailer] -> prints the line for it
+    : > "$TMP/times"
+    rss=0
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        result=$(run "$2" "$4") || exit 1
+        echo "${result% *}" >> "$TMP/times"
+        [ "${result#* }" -gt $rss ] && rss=${result#* }
+        i=$((i + 1))
+    done
+    sort -n "$TMP/times" | awk -v name="$1" -v ops="$3" -v rss=$rss -v startup="${startup:-0}" '
+        { t[NR] = $1 }
+        END {
+            median = t[int((NR + 1) / 2)]
+            net = median - startup
+            if (net < 1)  net = 1
+            printf "%-10s %4d %9d %9d %10d %12.0f %9d\n", name, NR, median, t[1], ops, ops * 1000 / net, rss
+        }'
+}
+
+compare () {  # adds the baseline's median and the change to each line of results
+    awk -v tolerance="$TOLERANCE" '
+        FNR == NR { if ($1 !~ /^#/ && NF >= 3)  base[$1] = $3; next }
+        /^#/ { print; next }
+        {
+            if (!($1 in base) || base[$1] <= 0) { printf "%s %9s %8s %s\n", $0, "-", "-", "new"; next }
+            change = 100 * ($3 - base[$1]) / base[$1]
+            verdict = "ok"
+            if (change > tolerance) { verdict = "REGRESSION"; regressions++ }
+            else if (change < -tolerance)  verdict = "faster"
+            printf "%s %9d %+7.1f%% %s\n", $0, base[$1], change, verdict
+        }
+        END { exit regressions > 0 }' "$BASELINE" -
+}
+
+{
+    echo "# $FROTH, $RUNS runs each, $(date -u +%Y-%m-%dT%H:%M:%SZ)"
+    printf "# %-8s %4s %9s %9s %10s %12s %9s\n" name runs median_ms min_ms ops ops_per_s maxrss_kb
+    startup=
+    line=$(measure startup "$TMP/empty.fs" 0) || exit 1
+    echo "$line"
+    startup=$(echo "$line" | awk '{ print $3 }')
+
+    for name in $WORKLOADS; do
+        entry=$(echo "$SUITE" | awk -v name="$name" '$1 == name')
+        [ -n "$entry" ] || { echo "no workload called $name" >&2; exit 1; }
+        file=$(echo "$entry" | awk '{ print $2 }')
+        ops=$(echo "$entry" | awk '{ print $3 }')
+        trailer=$(echo "$entry" | awk '{ $1 = $2 = $3 = ""; sub(/^ +/, ""); print }')
+        [ "$file" = COMPILE ] && file=$TMP/compile.fs
+        measure "$name" "$file" "$ops" "$trailer" || exit 1
+    done
+} > "$TMP/results" || exit 1
+
+if [ -n "$BASELINE" ]; then
+    compare < "$TMP/results"
+else
+    cat "$TMP/results"
+fi
@@ -0,0 +1,5 @@
+\ Call/return microbenchmark: doubly recursive Fibonacci, about 30 million colon calls.
+\ Usage: cat base.fs bench/calls.fs | ./froth
+DEC
+: FIB ( n -- fib[n] )   DUP 2 < IF ELSE DUP 1- RECURSE SWAP 2 - RECURSE + THEN ;
+35 FIB . CR
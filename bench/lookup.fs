@@ -0,0 +1,19 @@
+\ Dictionary lookup: FINDs 16 names, a few of them missing, 200000 times over.
+\ Usage: bench/bench.sh, or: ./froth base.fs bench/lookup.fs
+\ Prints how many were found, which should be 13 of every 16.
+DEC
+: NAME, ( "name" -- )       BL WORD DUP C@ 1+ HERE @ SWAP DUP ALLOT CMOVE ;
+CREATE NAMES DROP
+NAME, DUP       NAME, SWAP      NAME, FIND      NAME, SEE       NAME, NO-SUCH-WORD
+NAME, TASKS     NAME, CREATE    NAME, XT-NAME   NAME, +LOOP     NAME, MARKER
+NAME, NOR-THIS  NAME, LATEST    NAME, BASE      NAME, CMOVE     NAME, EMIT      NAME, zzz
+ALIGN HERE @ CONSTANT NAMES-END
+: FIND-ALL ( found -- found' )
+    NAMES BEGIN DUP NAMES-END < WHILE
+        DUP FIND IF SWAP 1+ SWAP THEN
+        DUP C@ 1+ +
+    REPEAT
+    DROP
+;
+: LOOKUPS ( n -- found )    0 SWAP 0 DO FIND-ALL LOOP ;
+200000 LOOKUPS . CR
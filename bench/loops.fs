@@ -0,0 +1,19 @@
+\ Nested counted loops, written with DO LOOP and by hand with the return stack.
+\ Usage: bench/loops.sh, or: { cat bench/loops.fs; echo "1000 DO-LOOPS . CR"; } | ./froth base.fs
+\ Both count the iterations of a 1000 x n nest, doing nothing else in the inner loop.
+DEC
+: DO-LOOPS ( n -- count )
+    0 SWAP 0 DO
+        1000 0 DO 1+ LOOP
+    LOOP
+;
+: HAND-LOOPS ( n -- count )
+    0 SWAP >R
+    BEGIN R@ 0> WHILE
+        1000 >R
+        BEGIN R@ 0> WHILE 1+ R1- REPEAT
+        R> DROP
+        R1-
+    REPEAT
+    R> DROP
+;
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Time a 1000 x N loop nest written with DO LOOP against the same written by hand.
+# Usage: bench/loops.sh [N]
+
+FROTH=${FROTH:-./froth}
+N=${1:-20000}
+
+run () {  # word -> wall ms
+    start=$(date +%s%N)
+    { cat bench/loops.fs; echo "$N $1 . CR"; } | $FROTH base.fs >/dev/null 2>&1 \
+        || { echo "$FROTH failed running $1" >&2; exit 1; }
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 ))
+}
+
+base=$(run "DROP 0")
+printf "%12s %10s %12s\n" loops "wall ms" "ns/iteration"
+for word in DO-LOOPS HAND-LOOPS; do
+    ms=$(run "$word")
+    ns=$(awk "BEGIN { printf \"%.2f\", ($ms - $base) * 1e6 / ($N * 1000) }")
+    printf "%12s %10d %12s\n" "$word" "$ms" "$ns"
+done
@@ -0,0 +1,16 @@
+\ String parsing: splits a line of decimal numbers on spaces and adds them up, a character
+\ at a time, 100000 times over (8.5 million characters).
+\ Usage: bench/bench.sh, or: ./froth base.fs bench/parse.fs
+DEC
+: TEXT ( -- addr len )
+    S" 12 345 6789 0 42 31337 7 88 1000 65535 271828 314159 999 1 23 456 7890 11 222 3333 4 "
+;
+: SUM-NUMBERS ( addr len -- sum )
+    0 0 2SWAP OVER + SWAP       ( sum n end addr )
+    ?DO
+        I C@ DUP 32 = IF  DROP + 0  ELSE  48 - SWAP 10 * +  THEN
+    LOOP
+    +
+;
+: PARSES ( n -- sum )       0 SWAP 0 DO DROP TEXT SUM-NUMBERS LOOP ;
+100000 PARSES . CR
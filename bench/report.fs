@@ -0,0 +1,9 @@
+\ Printing a report: 200000 rows of right-aligned numbers and text, about 8 MB of output.
+\ Usage: bench/bench.sh (which sends it to /dev/null), or: ./froth base.fs bench/report.fs
+DEC
+: ROW ( n -- )
+    DUP 8 .R SPACE  DUP DUP * 14 U.R  S"  items at " TELL  DUP 3 * 7 .R
+    S"  each, " TELL  -7 * . CR
+;
+: REPORT ( n -- )    0 DO I ROW LOOP ;
+200000 REPORT
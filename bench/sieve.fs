@@ -0,0 +1,17 @@
+\ Sieve of Eratosthenes, as in the BYTE benchmark: the 1899 primes below 16384, 500 times.
+\ Usage: bench/bench.sh, or: ./froth base.fs bench/sieve.fs
+DEC
+8190 CONSTANT SIZE
+CREATE FLAGS DROP SIZE ALLOT
+: PRIMES ( -- count )
+    SIZE 0 DO 1 FLAGS I + C! LOOP
+    0 SIZE 0 DO
+        FLAGS I + C@ IF
+            I DUP + 3 +  DUP I +        ( count prime k )
+            BEGIN DUP SIZE < WHILE  0 OVER FLAGS + C!  OVER +  REPEAT
+            2DROP 1+
+        THEN
+    LOOP
+;
+: SIEVE ( n -- count )    0 SWAP 0 DO DROP PRIMES LOOP ;
+500 SIEVE . CR
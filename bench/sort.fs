@@ -0,0 +1,20 @@
+\ Bubble sort of 1000 cells, from descending to ascending order, 10 times.
+\ Usage: bench/bench.sh, or: ./froth base.fs bench/sort.fs
+\ About 5 million compares, and as many swaps.  Prints 1 if the result is sorted.
+DEC
+1000 CONSTANT N
+CREATE DATA DROP N CELLS ALLOT
+: ELEMENT ( i -- addr )     CELLS DATA + ;
+: DESCENDING ( -- )         N 0 DO N I - I ELEMENT ! LOOP ;
+: EXCHANGE ( addr a b -- )  ROT OVER 1 CELLS + ! ! ;
+: BUBBLE ( -- )
+    N 1 DO
+        N I - 0 DO
+            I ELEMENT DUP @ OVER 1 CELLS + @    ( addr a b )
+            2DUP > IF EXCHANGE ELSE 2DROP DROP THEN
+        LOOP
+    LOOP
+;
+: SORTED? ( -- flag )       1 N 1 DO I 1- ELEMENT @ I ELEMENT @ > IF DROP 0 THEN LOOP ;
+: SORTS ( n -- )            0 DO DESCENDING BUBBLE LOOP ;
+10 SORTS SORTED? . CR
@@ -0,0 +1,7 @@
+\ Task switch microbenchmark: NTASKS tasks each PAUSE NROUNDS times, round robin.
+\ Usage: bench/tasks.sh, which defines NTASKS and NROUNDS before this
+DEC
+: WORKER    NROUNDS BEGIN PAUSE 1- DUP 0= UNTIL DROP ;
+: SPAWN ( n -- )    BEGIN ['] WORKER TASK WAKE 1- DUP 0= UNTIL DROP ;
+: RUN       BEGIN PAUSE TASKS 0= UNTIL ;
+NTASKS SPAWN RUN
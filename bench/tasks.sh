@@ -0,0 +1,28 @@
+#!/bin/sh
+# Cost of a task switch (PAUSE), and how it holds up as the number of tasks grows.
+# Usage: bench/tasks.sh [switches] [task counts...]
+# Each run makes N tasks that PAUSE until there have been about that many switches in all.
+# A run with a single round per task is subtracted, to leave out making and freeing them.
+
+FROTH=${FROTH:-./froth}
+SWITCHES=${1:-2000000}
+[ $# -gt 0 ] && shift
+COUNTS=${*:-1 10 100 1000 10000}
+
+run () {  # tasks rounds -> wall ms
+    start=$(date +%s%N)
+    { echo "$1 CONSTANT NTASKS $2 CONSTANT NROUNDS"; cat bench/tasks.fs; } \
+        | $FROTH base.fs >/dev/null 2>&1 || { echo "$FROTH failed with $1 tasks" >&2; exit 1; }
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 ))
+}
+
+printf "%8s %8s %10s %10s %12s\n" tasks rounds "wall ms" "setup ms" "ns/switch"
+for n in $COUNTS; do
+    rounds=$(( SWITCHES / n ))
+    [ "$rounds" -gt 1 ] || rounds=2
+    ms=$(run "$n" "$rounds")
+    setup=$(run "$n" 1)
+    ns=$(awk "BEGIN { printf \"%.1f\", ($ms - $setup) * 1e6 / (($n + 1) * ($rounds - 1)) }")
+    printf "%8d %8d %10d %10d %12s\n" "$n" "$rounds" "$ms" "$setup" "$ns"
+done
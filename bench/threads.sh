@@ -0,0 +1,24 @@
+#!/bin/sh
+# Throughput scaling with independent VMs, one per thread.
+# Usage: bench/threads.sh [workload.fs] [thread counts...]
+# base.fs is shared by every thread, each of which runs the workload in a VM of its own.
+# An ideal result keeps the wall time flat as the thread count goes up, until it passes
+# the number of cores.
+
+FROTH=${FROTH:-./froth}
+WORKLOAD=${1:-bench/arith.fs}
+[ $# -gt 0 ] && shift
+COUNTS=${*:-1 2 4 8}
+
+printf "%8s %10s %12s %10s\n" threads "wall ms" "runs/s" speedup
+base=""
+for n in $COUNTS; do
+    start=$(date +%s%N)
+    $FROTH -j "$n" -s base.fs "$WORKLOAD" >/dev/null 2>&1 || { echo "$FROTH -j $n failed" >&2; exit 1; }
+    end=$(date +%s%N)
+    ms=$(( (end - start) / 1000000 ))
+    [ "$ms" -gt 0 ] || ms=1
+    rate=$(awk "BEGIN { printf \"%.2f\", $n * 1000 / $ms }")
+    [ -n "$base" ] || base=$rate
+    printf "%8d %10d %12s %9sx\n" "$n" "$ms" "$rate" "$(awk "BEGIN { printf \"%.2f\", $rate / $base }")"
+done
@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "exception.h"
 #include "forth.h"
@@ -12,25 +13,28 @@
 // Function signature for a primitive
 #define DECLARE_PRIMITIVE(P)    void P(void *pfa)
 
-// Define a primitive and add it to the dictionary
+// Define a primitive and add it to the dictionary.  EFFECT_CNAME (see builtin.h) is its stack
+// effect, which genh reads from the ( before -- after ) comment just above it
 #define PRIMITIVE(NAME, FLAGS, CNAME, LINK)                                         \
     DECLARE_PRIMITIVE(CNAME);                                                       \
     DictEntry _dict_##CNAME =                                                       \
-        { &_dict_##LINK, ((FLAGS) | (sizeof(NAME) - 1)), NAME, SENTINEL, CNAME, };  \
+        { &_dict_##LINK, ((FLAGS) | (sizeof(NAME) - 1)), NAME,                      \
+            SENTINEL, EFFECT_##CNAME, CNAME, };                                     \
     DECLARE_PRIMITIVE(CNAME)
 
-// Define a variable and add it to the dictionary; also create a pointer for direct access
+// Define a variable and add it to the dictionary.  Each VM has its own copy of the value,
+// in its user area, which var_NAME (see builtin.h) points to directly.  The entry just
+// holds the index into the user area, and the value a new VM starts with
 #define VARIABLE(NAME, INITIAL, FLAGS, LINK)                        \
     DictEntry _dict_var_##NAME =                                    \
         { &_dict_##LINK, ((FLAGS) | (sizeof(#NAME) - 1)), #NAME,    \
-            SENTINEL, do_variable, {{INITIAL}} };                   \
-    cell * const var_##NAME = &_dict_var_##NAME.param[0]
+            SENTINEL, F2_EFFECT, 0, 1, 1, do_user, {{USER_##NAME}, {INITIAL}} }
 
 // Define a constant and add it to the dictionary; also create a pointer for direct access
 #define CONSTANT(NAME, VALUE, FLAGS, LINK)                          \
     DictEntry _dict_const_##NAME =                                  \
         { &_dict_##LINK, ((FLAGS) | (sizeof(#NAME) - 1)), #NAME,    \
-            SENTINEL, do_constant, {{VALUE}} };                     \
+            SENTINEL, F2_EFFECT, 0, 1, 1, do_constant, {{VALUE}} }; \
     const cell * const const_##NAME = &_dict_const_##NAME.param[0]
 
 // Define a "read only" variable and add it to the dictionary (special case of PRIMITIVE)
@@ -38,12 +42,23 @@
     DECLARE_PRIMITIVE(readonly_##NAME);                             \
     DictEntry _dict_readonly_##NAME =                               \
         { &_dict_##LINK, ((FLAGS) | (sizeof(#NAME) - 1)), #NAME,    \
-            SENTINEL, readonly_##NAME, };                           \
+            SENTINEL, F2_EFFECT, 0, 1, 1, readonly_##NAME, };       \
     DECLARE_PRIMITIVE(readonly_##NAME) { REG(a); a = (CELLFUNC); DPUSH(a); }
 
+// Define a threaded-code operation and add it to the dictionary.  These have no C function of
+// their own: do_colon recognises the do_threaded code field and runs OPCODE inline.  Their
+// stack effects come from the comments above them too
+#define THREADED(NAME, FLAGS, CNAME, LINK, OPCODE)                                  \
+    DictEntry _dict_##CNAME =                                                       \
+        { &_dict_##LINK, ((FLAGS) | (sizeof(NAME) - 1)), NAME,                      \
+            SENTINEL, EFFECT_##CNAME, do_threaded, {{OPCODE}} }
+
 // Shorthand macros to make repetitive code more writeable, but possibly less readable
 #define REG(X)          register cell X
 
+// Longest file name INCLUDED, SAVE-IMAGE etc will accept
+#define MAX_PATH_LENGTH (4096)
+
 
 /***************************************************************************
     The __ROOT DictEntry delimits the root of the dictionary
@@ -53,6 +68,10 @@ DictEntry _dict___ROOT = {
     0,      // name length + flags
     "",     // name
     0,      // sentinel
+    0,      // flags2
+    0,      // effect_in
+    0,      // effect_out
+    0,      // effect_max
     NULL,   // code
 };
 
@@ -66,13 +85,21 @@ VARIABLE (BASE,     0,              0,          __ROOT);        // default to sm
 VARIABLE (UINCR,    INIT_UINCR,     0,          var_BASE);      //
 VARIABLE (UTHRES,   INIT_UTHRES,    0,          var_UINCR);     //
 VARIABLE (HERE,     0,              0,          var_UTHRES);    // default to NULL
+VARIABLE (FUSION,   1,              0,          var_HERE);      // compile superinstructions
+VARIABLE (RSIZE,    INIT_RSIZE,     0,          var_FUSION);    // return stack cells, from the next QUIT or TASK
+VARIABLE (LEAVES,   0,              0,          var_RSIZE);     // LEAVE fixups for the DO being compiled
+VARIABLE (TAILCALLS, 1,             0,          var_LEAVES);    // compile a call just before EXIT as a jump
+VARIABLE (AUTOINLINE, 0,            0,          var_TAILCALLS); // inline colon definitions up to this many cells
+VARIABLE (FOLDING,  1,              0,          var_AUTOINLINE); // fold constants, drop dead code
+VARIABLE (JIT,      0,              0,          var_FOLDING);   // compile colon definitions to machine code at ;
+VARIABLE (WARNINGS, 1,              0,          var_JIT);       // say when a definition is unbalanced
 
 
 /***************************************************************************
   Builtin constants -- keep these together
     CONSTANT(NAME, VALUE, FLAGS, LINK)
  ***************************************************************************/
-CONSTANT (VERSION,      0,                      0,  var_HERE);
+CONSTANT (VERSION,      0,                      0,  var_WARNINGS);
 CONSTANT (DOCOL,        (intptr_t)&do_colon,    0,  const_VERSION);
 CONSTANT (DOVAR,        (intptr_t)&do_variable, 0,  const_DOCOL);
 CONSTANT (DOCON,        (intptr_t)&do_constant, 0,  const_DOVAR);
@@ -98,53 +125,29 @@ CONSTANT (UCELL_MAX,    UINTPTR_MAX,            0,  const_UCELL_MIN);
 
 READONLY (U0,           (cell)mem_get_start(),              0, const_UCELL_MAX);
 READONLY (USIZE,        (cell)(uintptr_t)mem_get_ncells(),  0, readonly_U0);
-READONLY (DOCOLMODE,    (cell)(intptr_t)docolon_mode,       0, readonly_USIZE);
-READONLY (STATE,        (cell)(intptr_t)interpreter_state,  0, readonly_DOCOLMODE);
+READONLY (STATE,        (cell)(intptr_t)vm->interpreter_state,  0, readonly_USIZE);
 
 
 /***************************************************************************
   Builtin code words -- keep these together
     PRIMITIVE(NAME, FLAGS, CNAME, LINK)
+    THREADED(NAME, FLAGS, CNAME, LINK, OPCODE)  -- implemented in do_colon
  ***************************************************************************/
 
 // ( a -- )
-PRIMITIVE ("DROP", 0, _DROP, readonly_STATE) {
-    REG(a);
-    DPOP(a);
-}
+THREADED ("DROP", 0, _DROP, readonly_STATE, OP_DROP);
 
 
 // ( b a -- a b )
-PRIMITIVE ("SWAP", 0, _SWAP, _DROP) {
-    REG(a);
-    REG(b);
+THREADED ("SWAP", 0, _SWAP, _DROP, OP_SWAP);
 
-    DPOP(a);
-    DPOP(b);
-    DPUSH(a);
-    DPUSH(b);
-}
 
-
-// ( a - a a )
-PRIMITIVE ("DUP", 0, _DUP, _SWAP) {
-    REG(a);
-    
-    DPEEK(a);
-    DPUSH(a);
-}
+// ( a -- a a )
+THREADED ("DUP", 0, _DUP, _SWAP, OP_DUP);
 
 
 // ( b a -- b a b )
-PRIMITIVE ("OVER", 0, _OVER, _DUP) {
-    REG(a);
-    REG(b);
-
-    DPOP(a);
-    DPEEK(b);
-    DPUSH(a);
-    DPUSH(b);
-}
+THREADED ("OVER", 0, _OVER, _DUP, OP_OVER);
 
 
 // ( b a -- a b a )
@@ -179,18 +182,7 @@ PRIMITIVE ("ROLL", 0, _ROLL, _PICK) {
 
 
 // ( c b a -- a c b )
-PRIMITIVE ("ROT", 0, _ROT, _ROLL) {
-    REG(a);
-    REG(b);
-    REG(c);
-
-    DPOP(a);
-    DPOP(b);
-    DPOP(c);
-    DPUSH(a);
-    DPUSH(c);
-    DPUSH(b);
-}
+THREADED ("ROT", 0, _ROT, _ROLL, OP_ROT);
 
 
 // ( c b a -- b a c )
@@ -220,10 +212,10 @@ PRIMITIVE ("2DROP", 0, _2DROP, _negROT) {
 PRIMITIVE ("NDROP", 0, _NDROP, _2DROP) {
     register intptr_t n;
 
-    n = stack_pop(&data_stack).as_i;
-    n = data_stack.top - n;
+    n = stack_pop(&vm->task->data_stack).as_i;
+    n = vm->task->data_stack.top - n;
     if (n < -1)  n = -1;
-    data_stack.top = n;
+    vm->task->data_stack.top = n;
 }
 
 
@@ -245,7 +237,7 @@ PRIMITIVE ("NDUP", 0, _NDUP, _2DUP) {  // FIXME this implementation sucks
     cell *buf;
     register uintptr_t n;
 
-    n = stack_pop(&data_stack).as_u;
+    n = stack_pop(&vm->task->data_stack).as_u;
 
     if ((buf = malloc(n * sizeof(cell))) != NULL) {
         for (register int i=0; i<n; i++)  DPOP(buf[i]);
@@ -288,25 +280,15 @@ PRIMITIVE ("?DUP", 0, _qDUP, _2SWAP) {
 }
 
 
-// ( a -- a + 1 )
-PRIMITIVE ("1+", 0, _1plus, _qDUP) {
-    REG(a);
+// ( a -- a+1 )
+THREADED ("1+", 0, _1plus, _qDUP, OP_1PLUS);
 
-    DPOP(a);
-    DPUSH((cell) (a.as_i + 1));
-}
 
-
-// ( a -- a - 1 )
-PRIMITIVE ("1-", 0, _1minus, _1plus) {
-    REG(a);
-    
-    DPOP(a);
-    DPUSH((cell) (a.as_i - 1));
-}
+// ( a -- a-1 )
+THREADED ("1-", 0, _1minus, _1plus, OP_1MINUS);
 
 
-// ( a -- a + 4 )
+// ( a -- a+4 )
 PRIMITIVE ("4+", 0, _4plus, _1minus) {
     REG(a);
 
@@ -315,7 +297,7 @@ PRIMITIVE ("4+", 0, _4plus, _1minus) {
 }
 
 
-// ( a -- a - 4 )
+// ( a -- a-4 )
 PRIMITIVE ("4-", 0, _4minus, _4plus) {
     REG(a);
 
@@ -324,40 +306,19 @@ PRIMITIVE ("4-", 0, _4minus, _4plus) {
 }
 
 
-// ( a b -- a + b )
-PRIMITIVE ("+", 0, _plus, _4minus) {
-    REG(a);
-    REG(b);
-
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell) (a.as_i + b.as_i));
-}
+// ( a b -- a+b )
+THREADED ("+", 0, _plus, _4minus, OP_PLUS);
 
 
-// ( a b -- a - b )
-PRIMITIVE ("-", 0, _minus, _plus) {
-    REG(a);
-    REG(b);
+// ( a b -- a-b )
+THREADED ("-", 0, _minus, _plus, OP_MINUS);
 
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell) (a.as_i - b.as_i));
-}
 
+// ( a b -- product )
+THREADED ("*", 0, _multiply, _minus, OP_MULTIPLY);
 
-// ( a b -- a * b )
-PRIMITIVE ("*", 0, _multiply, _minus) {
-    REG(a);
-    REG(b);
 
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell) (a.as_i * b.as_i));
-}
-
-
-// ( a b -- a / b)
+// ( a b -- a/b )
 PRIMITIVE ("/", 0, _divide, _multiply) {
     REG(a);
     REG(b);
@@ -368,7 +329,7 @@ PRIMITIVE ("/", 0, _divide, _multiply) {
 }
 
 
-// ( a b -- a % b)
+// ( a b -- a%b )
 PRIMITIVE ("MOD", 0, _modulus, _divide) {
     REG(a);
     REG(b);
@@ -379,203 +340,83 @@ PRIMITIVE ("MOD", 0, _modulus, _divide) {
 }
 
 
-// ( a b -- a == b )
-PRIMITIVE ("=", 0, _equals, _modulus) {
-    REG(a);
-    REG(b);
-
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i == b.as_i));
-}
-
-
-// ( a b -- a != b )
-PRIMITIVE ("<>", 0, _notequals, _equals) {
-    REG(a);
-    REG(b);
-
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i != b.as_i));
-}
-
-
-// ( a b -- a < b )
-PRIMITIVE ("<", 0, _lt, _notequals) {
-    REG(a);
-    REG(b);
-
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i < b.as_i));
-}
-
-
-// ( a b -- a > b )
-PRIMITIVE (">", 0, _gt, _lt) {
-    REG(a);
-    REG(b);
-
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i > b.as_i));
-}
-
-
-// ( a b -- a <= b )
-PRIMITIVE ("<=", 0, _lte, _gt) {
-    REG(a);
-    REG(b);
-
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i <= b.as_i));
-}
-
-
-// ( a b -- a >= b )
-PRIMITIVE (">=", 0, _gte, _lte) {
-    REG(a);
-    REG(b);
+// ( a b -- a==b )
+THREADED ("=", 0, _equals, _modulus, OP_EQUALS);
 
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i >= b.as_i));
-}
 
+// ( a b -- a!=b )
+THREADED ("<>", 0, _notequals, _equals, OP_NOTEQUALS);
 
-// ( a -- a == 0 )
-PRIMITIVE ("0=", 0, _zero_equals, _gte) {
-    REG(a);
 
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i == 0));
-}
+// ( a b -- a<b )
+THREADED ("<", 0, _lt, _notequals, OP_LT);
 
 
-// ( a -- a != 0 )
-PRIMITIVE ("0<>", 0, _notzero_equals, _zero_equals) {
-    REG(a);
+// ( a b -- a>b )
+THREADED (">", 0, _gt, _lt, OP_GT);
 
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i != 0));
-}
 
+// ( a b -- a<=b )
+THREADED ("<=", 0, _lte, _gt, OP_LTE);
 
-// ( a -- a < 0 )
-PRIMITIVE ("0<", 0, _zero_lt, _notzero_equals) {
-    REG(a);
 
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i < 0));
-}
+// ( a b -- a>=b )
+THREADED (">=", 0, _gte, _lte, OP_GTE);
 
 
-// ( a -- a > 0 )
-PRIMITIVE ("0>", 0, _zero_gt, _zero_lt) {
-    REG(a);
+// ( a -- a==0 )
+THREADED ("0=", 0, _zero_equals, _gte, OP_ZERO_EQUALS);
 
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i > 0));
-}
 
+// ( a -- a!=0 )
+THREADED ("0<>", 0, _notzero_equals, _zero_equals, OP_NOTZERO_EQUALS);
 
-// ( a -- a <= 0 )
-PRIMITIVE ("0<=", 0, _zero_lte, _zero_gt) {
-    REG(a);
 
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i <= 0));
-}
+// ( a -- a<0 )
+THREADED ("0<", 0, _zero_lt, _notzero_equals, OP_ZERO_LT);
 
 
-// ( a -- a >= 0 )
-PRIMITIVE ("0>=", 0, _zero_gte, _zero_lte) {
-    REG(a);
+// ( a -- a>0 )
+THREADED ("0>", 0, _zero_gt, _zero_lt, OP_ZERO_GT);
 
-    DPOP(a);
-    DPUSH((cell)(intptr_t) (a.as_i >= 0));
-}
 
+// ( a -- a<=0 )
+THREADED ("0<=", 0, _zero_lte, _zero_gt, OP_ZERO_LTE);
 
-// ( a b -- a & b )
-PRIMITIVE ("AND", 0, _AND, _zero_gte) {
-    REG(a);
-    REG(b);
 
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell) (a.as_u & b.as_u));
-}
+// ( a -- a>=0 )
+THREADED ("0>=", 0, _zero_gte, _zero_lte, OP_ZERO_GTE);
 
 
-// ( a b -- a | b )
-PRIMITIVE ("OR", 0, _OR, _AND) {
-    REG(a);
-    REG(b);
+// ( a b -- a&b )
+THREADED ("AND", 0, _AND, _zero_gte, OP_AND);
 
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell) (a.as_u | b.as_u));
-}
 
+// ( a b -- a|b )
+THREADED ("OR", 0, _OR, _AND, OP_OR);
 
-// ( a b -- a ^ b )
-PRIMITIVE ("XOR", 0, _XOR, _OR) {
-    REG(a);
-    REG(b);
 
-    DPOP(b);
-    DPOP(a);
-    DPUSH((cell) (a.as_u ^ b.as_u));
-}
+// ( a b -- a^b )
+THREADED ("XOR", 0, _XOR, _OR, OP_XOR);
 
 
 // ( a -- ~a )
-PRIMITIVE ("INVERT", 0, _INVERT, _XOR) {
-    REG(a);
-
-    DPOP(a);
-    DPUSH((cell) ~a.as_u);
-}
+THREADED ("INVERT", 0, _INVERT, _XOR, OP_INVERT);
 
 
 /* Memory access primitives */
 
 
 // ( a addr -- )
-PRIMITIVE ("!", 0, _store, _INVERT) {
-    REG(addr);
-    REG(a);
-
-    DPOP(addr);
-    DPOP(a);
-
-    *addr.as_dfa = a;
-}
+THREADED ("!", 0, _store, _INVERT, OP_STORE);
 
 
 // ( addr -- a )
-PRIMITIVE ("@", 0, _fetch, _store) {
-    REG(addr);
-    REG(a);
-
-    DPOP(addr);
-    a = *addr.as_dfa;
-    DPUSH(a);
-}
+THREADED ("@", 0, _fetch, _store, OP_FETCH);
 
 
 // ( delta addr -- )
-PRIMITIVE ("+!", 0, _addstore, _fetch) {
-    REG(a);
-    REG(b);
-
-    DPOP(a);
-    DPOP(b);
-    a.as_dfa->as_i += b.as_i;
-}
+THREADED ("+!", 0, _addstore, _fetch, OP_ADDSTORE);
 
 
 // ( delta addr -- )
@@ -590,25 +431,11 @@ PRIMITIVE ("-!", 0, _substore, _addstore) {
 
 
 // ( value addr -- )
-PRIMITIVE ("C!", 0, _storebyte, _substore) {
-    REG(a);
-    REG(b);
-
-    DPOP(a);
-    DPOP(b);
-    *(char*) a.as_ptr = (char) b.as_i;
-}
+THREADED ("C!", 0, _storebyte, _substore, OP_STOREBYTE);
 
 
 // ( addr -- value )
-PRIMITIVE ("C@", 0, _fetchbyte, _storebyte) {
-    REG(a);
-    register uintptr_t b;
-
-    DPOP(a);
-    b = *(unsigned char*) a.as_ptr;
-    DPUSH((cell) b);
-}
+THREADED ("C@", 0, _fetchbyte, _storebyte, OP_FETCHBYTE);
 
 
 // ( src dest -- src+1 dest+1 )
@@ -644,6 +471,7 @@ PRIMITIVE ("ALLOT", 0, _ALLOT, _cmove) {
     REG(n);
 
     DPOP(n);
+    if (n.as_i > 0)  mem_ensure(n.as_u);
     var_HERE->as_i += n.as_i;
 }
 
@@ -654,12 +482,7 @@ PRIMITIVE ("ALLOT", 0, _ALLOT, _cmove) {
 //not place there using >R or 2>R;
 
 // ( a -- ) ( R: -- a )
-PRIMITIVE (">R", F_COMPONLY, _ltR, _ALLOT) {
-    REG(a);
-
-    DPOP(a);
-    RPUSH(a);
-}
+THREADED (">R", F_COMPONLY, _ltR, _ALLOT, OP_LTR);
 
 
 // ( a b -- ) ( R: -- a b )
@@ -675,12 +498,7 @@ PRIMITIVE ("2>R", F_COMPONLY, _2ltR, _ltR) {
 
 
 // ( -- a ) ( R: a -- )
-PRIMITIVE ("R>", F_COMPONLY, _Rgt, _2ltR) {
-    REG(a);
-
-    RPOP(a);
-    DPUSH(a);
-}
+THREADED ("R>", F_COMPONLY, _Rgt, _2ltR, OP_RGT);
 
 
 // ( -- a b ) ( R: a b -- )
@@ -696,12 +514,7 @@ PRIMITIVE ("2R>", F_COMPONLY, _2Rgt, _Rgt) {
 
 
 // ( -- a ) ( R: a -- a )
-PRIMITIVE ("R@", F_COMPONLY, _Rat, _2Rgt) {
-    REG(a);
-
-    RPEEK(a);
-    DPUSH(a);
-}
+THREADED ("R@", F_COMPONLY, _Rat, _2Rgt, OP_RAT);
 
 
 // ( -- a b ) ( R: a b -- a b )
@@ -719,8 +532,8 @@ PRIMITIVE ("2R@", F_COMPONLY, _2Rat, _Rat) {
 
 // ( R: a -- a+1 )
 PRIMITIVE ("R1+", F_COMPONLY, _R1plus, _2Rat) {
-    if (stack_count(&return_stack)) {
-        return_stack.values[return_stack.top].as_i ++;
+    if (stack_count(&vm->task->return_stack)) {
+        vm->task->return_stack.values[vm->task->return_stack.top].as_i ++;
     }
     // FIXME error handling
 }
@@ -728,17 +541,48 @@ PRIMITIVE ("R1+", F_COMPONLY, _R1plus, _2Rat) {
 
 // ( R: a -- a-1 )
 PRIMITIVE ("R1-", F_COMPONLY, _R1minus, _R1plus) {
-    if (stack_count(&return_stack)) {
-        return_stack.values[return_stack.top].as_i --;
+    if (stack_count(&vm->task->return_stack)) {
+        vm->task->return_stack.values[vm->task->return_stack.top].as_i --;
     }
     // FIXME error handling
 }
 
 
+/* Counted loops, see DO etc in base.fs.  The limit is kept on the return stack with the
+   index on top of it, so (LOOP) is a single op per iteration */
+
+// ( limit start -- ) ( R: -- limit index )
+THREADED ("(DO)", F_COMPONLY, _paren_DO, _R1minus, OP_DO);
+
+
+// ( limit start -- ) ( R: -- limit index | )  skips the loop if limit = start
+THREADED ("(?DO)", F_COMPONLY, _paren_qDO, _paren_DO, OP_QDO);
+
+
+// ( -- ) ( R: limit index -- limit index+1 | )
+THREADED ("(LOOP)", F_COMPONLY, _paren_LOOP, _paren_qDO, OP_LOOP);
+
+
+// ( n -- ) ( R: limit index -- limit index+n | )
+THREADED ("(+LOOP)", F_COMPONLY, _paren_plusLOOP, _paren_LOOP, OP_PLUSLOOP);
+
+
+// ( -- index ) ( R: limit index -- limit index )
+THREADED ("I", F_COMPONLY, _I, _paren_plusLOOP, OP_I);
+
+
+// ( -- index2 ) ( R: limit2 index2 limit1 index1 -- limit2 index2 limit1 index1 )
+THREADED ("J", F_COMPONLY, _J, _I, OP_J);
+
+
+// ( R: limit index -- )
+THREADED ("UNLOOP", F_COMPONLY, _UNLOOP, _J, OP_UNLOOP);
+
+
 /* Control stack primitives */
 
 // ( a -- ) ( C: -- a )
-PRIMITIVE (">CTRL", F_COMPONLY, _gtCTRL, _R1minus) {
+PRIMITIVE (">CTRL", F_COMPONLY, _gtCTRL, _UNLOOP) {
     REG(a);
 
     DPOP(a);
@@ -812,35 +656,35 @@ PRIMITIVE ("ASSERT", 0, _ASSERT, _2CTRLat) {
     n = a.as_u;
     // FIXME don't flip out on negative input
 
-    if (stack_count(&data_stack) >= 2 * n) {
-        cell *orig = &data_stack.values[1 + data_stack.top - 2 * n];
-        cell *dup  = &data_stack.values[1 + data_stack.top - n];
+    if (stack_count(&vm->task->data_stack) >= 2 * n) {
+        cell *orig = &vm->task->data_stack.values[1 + vm->task->data_stack.top - 2 * n];
+        cell *dup  = &vm->task->data_stack.values[1 + vm->task->data_stack.top - n];
         if (memcmp(orig, dup, n * sizeof(cell)) == 0) {
-            puts("ASSERT passed");
+            output_write("ASSERT passed\n", 14);
         }
         else {
-            printf("ASSERT %"PRIuPTR" failed:\n", n);
+            output_printf("ASSERT %"PRIuPTR" failed:\n", n);
             int i;
             for (i=0; i < n; i++) {
-                if (i % 8 == 0)  printf("expected> ");
-                printf("%"PRIiPTR" ", dup[i].as_i);
-                if (i % 8 == 7)  putchar('\n');
+                if (i % 8 == 0)  output_printf("expected> ");
+                output_printf("%"PRIiPTR" ", dup[i].as_i);
+                if (i % 8 == 7)  output_char('\n');
             }
-            if (i % 8 != 0)  putchar('\n');
+            if (i % 8 != 0)  output_char('\n');
             for (i=0; i < n; i++) {
-                if (i % 8 == 0)  printf("found>    ");
-                printf("%"PRIiPTR" ", orig[i].as_i);
-                if (i % 8 == 7)  putchar('\n');
+                if (i % 8 == 0)  output_printf("found>    ");
+                output_printf("%"PRIiPTR" ", orig[i].as_i);
+                if (i % 8 == 7)  output_char('\n');
             }
-            if (i % 8 != 0)  putchar('\n');
+            if (i % 8 != 0)  output_char('\n');
         }
-        data_stack.top -= n;
+        vm->task->data_stack.top -= n;
     }
     else {
         // stack would underflow!
         fprintf(stderr, "ASSERT: Not enough elements on stack "
                         "(expected %"PRIuPTR", found %"PRIuPTR")\n",
-                        2 * n, stack_count(&data_stack));
+                        2 * n, stack_count(&vm->task->data_stack));
         _ABORT(NULL);
         // FIXME throw
     }
@@ -849,17 +693,17 @@ PRIMITIVE ("ASSERT", 0, _ASSERT, _2CTRLat) {
 
 // ( -- )
 PRIMITIVE (".S", 0, _dotS, _ASSERT) {
-    if (stack_count(&data_stack) == 0) {
-        puts("(empty)");
+    if (stack_count(&vm->task->data_stack) == 0) {
+        output_write("(empty)\n", 8);
     }
     else {
         register int i;
-        for (i = 0; i < stack_count(&data_stack); i++) {
-            if (i % 8 == 0)  printf("stack>  ");
-            printf("%"PRIiPTR" ", data_stack.values[i].as_i);
-            if (i % 8 == 7)  putchar('\n');
+        for (i = 0; i < stack_count(&vm->task->data_stack); i++) {
+            if (i % 8 == 0)  output_printf("stack>  ");
+            output_printf("%"PRIiPTR" ", vm->task->data_stack.values[i].as_i);
+            if (i % 8 == 7)  output_char('\n');
         }
-        if (i % 8 != 0)  putchar('\n');  // if the last number didn't just print one out itself
+        if (i % 8 != 0)  output_char('\n');  // if the last number didn't just print one out itself
     }
 }
 
@@ -870,11 +714,10 @@ PRIMITIVE (".S", 0, _dotS, _ASSERT) {
 PRIMITIVE ("KEY", 0, _KEY, _dotS) {
     REG(a);
 
-    /* stdio is line buffered when attached to terminals :) */
-    a = getkey();
-    if (a.as_i != EOF) {
+    a.as_i = input_key();
+    if (a.as_i != EOF || input_depth() > 0) {
+        // an included file just gives EOF when it runs out
         DPUSH(a);
-//        if (a == '\n')  puts(" ok");
     }
     else if (feof(stdin))  exit(0);
     else  exit(1);
@@ -886,47 +729,33 @@ PRIMITIVE ("EMIT", 0, _EMIT, _KEY) {
     REG(a);
 
     DPOP(a);
-    fputc(a.as_i, stdout);
+    output_char(a.as_i);
 }
 
 
 // ( delim -- c-addr )
 PRIMITIVE ("WORD", 0, _WORD, _EMIT) {
-    static int usebuf = 0;  // Double-buffered
-    static CountedString buf[2];
-    
-    register int i;
-    register int blflag;
+    CountedString * const buf = vm->word_buf;  // Double-buffered
+    int usebuf = vm->word_usebuf;
+    register intptr_t len;
     REG(delim);
-    REG(key);
-
-    memset(buf[usebuf].value, 0, sizeof(buf[usebuf].value));
 
     /* Get the delimiter */
     DPOP(delim);
-    blflag = (delim.as_i == ' ');  // Treat control chars as whitespace when delim is space
-
-    /* First skip leading delimiters */
-    do {
-        _KEY(NULL);
-        DPOP(key);
-        if (blflag && key.as_i < ' ')  key = delim;
-    } while (key.as_i == delim.as_i);
-
-    /* Then start storing chars in the buffer */
-    i = 0;
-    do {
-        buf[usebuf].value[i++] = key.as_i;
-        _KEY(NULL);
-        DPOP(key);
-        if (blflag && key.as_i < ' ')  key = delim;
-    } while (i < MAX_COUNTED_STRING_LENGTH && key.as_i != delim.as_i);
+
+    len = input_word(delim.as_i, buf[usebuf].value, MAX_COUNTED_STRING_LENGTH - 1);
+    if (len < 0) {
+        // Nothing left to read.  At the end of an included file that's just an empty word
+        if (input_depth() > 0)  len = 0;
+        else if (feof(stdin))  exit(0);
+        else  exit(1);
+    }
 
     /* Return address of counted string on the stack */
-    if (i < MAX_COUNTED_STRING_LENGTH) {
-        buf[usebuf].length = i;
+    if (len < MAX_COUNTED_STRING_LENGTH) {
+        buf[usebuf].length = len;
         DPUSH((cell)(uintptr_t) &buf[usebuf]);
-        usebuf = (usebuf == 0 ? 1 : 0);
+        vm->word_usebuf = (usebuf == 0 ? 1 : 0);
     }
     else {
         // Ran out of room
@@ -936,8 +765,99 @@ PRIMITIVE ("WORD", 0, _WORD, _EMIT) {
 }
 
 
+// ( -- addr len )
+PRIMITIVE ("SOURCE", 0, _SOURCE, _WORD) {
+    InputSource *source = input_current();
+
+    DPUSH((cell)(void *) source->buffer);
+    DPUSH((cell)(uintptr_t) source->length);
+}
+
+
+// ( -- addr )
+PRIMITIVE (">IN", 0, _toIN, _SOURCE) {
+    DPUSH((cell)(void *) &input_current()->in);
+}
+
+
+// ( -- flag )
+PRIMITIVE ("REFILL", 0, _REFILL, _toIN) {
+    DPUSH((cell)(intptr_t) input_refill());
+}
+
+
+// ( "name" -- c-addr u )
+PRIMITIVE ("PARSE-NAME", 0, _PARSE_NAME, _REFILL) {
+    const char *name = NULL;
+    intptr_t len;
+
+    // points straight into the input buffer, so it's only good until the next REFILL
+    if ((len = input_parse_name(&name)) < 0)  len = 0;
+
+    DPUSH((cell)(void *) name);
+    DPUSH((cell) len);
+}
+
+
+// Pops a ( c-addr u ) file name into path, which must have room for MAX_PATH_LENGTH
+static void pop_path (char *path) {
+    REG(addr);
+    REG(len);
+
+    DPOP(len);
+    DPOP(addr);
+
+    if (len.as_u >= MAX_PATH_LENGTH) {
+        throw(EXC_INVNAME);  /* doesn't return */
+    }
+    memcpy(path, addr.as_ptr, len.as_u);
+    path[len.as_u] = '\0';
+}
+
+
+// Interprets the source that was just pushed, until it runs out, then pops it again
+static void interpret_included () {
+    InputSource *source = input_current();
+
+    while (!source->eof)  do_interpret(NULL);
+
+    input_pop();
+}
+
+
+// ( i*x fd -- j*x )
+PRIMITIVE ("INCLUDE-FILE", 0, _INCLUDE_FILE, _PARSE_NAME) {
+    REG(fd);
+
+    DPOP(fd);
+
+    if (input_include_fd(fd.as_i) != 0) {
+        perror("INCLUDE-FILE");
+        throw(EXC_FILEIO);  /* doesn't return */
+    }
+
+    interpret_included();
+}
+
+
+// ( i*x c-addr u -- j*x )
+PRIMITIVE ("INCLUDED", 0, _INCLUDED, _INCLUDE_FILE) {
+    char path[MAX_PATH_LENGTH];
+
+    pop_path(path);
+
+    if (input_include_file(path) != 0) {
+        int saved_errno = errno;
+        perror(path);
+        throw(saved_errno == ENOENT ? EXC_NOFILE : EXC_FILEIO);  /* doesn't return */
+    }
+
+    interpret_included();
+}
+
+
 // ( c-addr -- n status )
-PRIMITIVE ("NUMBER", 0, _NUMBER, _WORD) {
+PRIMITIVE ("NUMBER", 0, _NUMBER, _INCLUDED) {
     CountedString *word;
     char *endptr;
     REG(a);
@@ -973,55 +893,29 @@ PRIMITIVE ("NUMBER", 0, _NUMBER, _WORD) {
 
 // ( u n -- )
 PRIMITIVE ("U.R", 0, _UdotR, _NUMBER) {
-    const char charset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    char buf[33];  // 32 digits, terminating '\0'
-    int minlen;
     REG(a);
-    register int i;
+    REG(b);
     register unsigned int base;
 
     base = ((var_BASE->as_u >= 2 && var_BASE->as_u <= 36) ? var_BASE->as_u : 10);
 
-    memset(buf, 0, sizeof(buf));
-    i = 32; // Start at end of string
+    DPOP(b);  // minimum width
     DPOP(a);
-    minlen = a.as_u;
-    DPOP(a);
-    do {
-        buf[--i] = charset[a.as_u % base];
-        a.as_u /= base;
-    } while (a.as_u);
-    // buf[i] is the start of the converted string
-    printf("%*.33s", minlen, &buf[i]);
+    output_number(a.as_i, 0, base, b.as_i > 0 ? b.as_u : 0);
 }
 
 
 // ( i n -- )
 PRIMITIVE (".R", 0, _dotR, _UdotR) {
-    const char charset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    char buf[34];  // possible sign, 32 digits, terminating '\0'
-    int neg;
-    int minlen;
     REG(a);
-    register int i;
+    REG(b);
     register unsigned int base;
 
     base = ((var_BASE->as_u >= 2 && var_BASE->as_u <= 36) ? var_BASE->as_u : 10);
 
-    memset(buf, 0, sizeof(buf));
-    i = 33; // Start at end of string
+    DPOP(b);  // minimum width
     DPOP(a);
-    minlen = a.as_u;
-    DPOP(a);
-    neg = (a.as_i < 0);
-    a.as_i = abs(a.as_i);  // FIXME when a == INTPTR_MIN, abs() will not work
-    do {
-        buf[--i] = charset[a.as_i % base];
-        a.as_i /= base;
-    } while (a.as_i);
-    if (neg)  buf[--i] = '-';
-    // buf[i] is the start of the converted string
-    printf("%*.33s", minlen, &buf[i]);
+    output_number(a.as_i, 1, base, b.as_i > 0 ? b.as_u : 0);
 }
 
 
@@ -1032,27 +926,25 @@ PRIMITIVE ("FIND", 0, _FIND, _dotR) {
     DPOP(a);
     CountedString *word = a.as_cs;
 
-    DictEntry *de = var_LATEST->as_de;
-    DictEntry *result = NULL;
+    DPUSH((cell) dict_find(word->value, word->length));
+}
 
-    while (de != &_dict___ROOT) {
-        // tricky - ignores hidden words
-        if (word->length == (de->flags & (F_HIDDEN | F_LENMASK))) { 
-            if (strncmp(word->value, de->name, word->length) == 0) {
-                // found a match
-                result = de;
-                break;
-            }
-        }
-        de = de->link;
-    }
 
-    DPUSH((cell) result);
+// ( -- )
+PRIMITIVE ("FIND-STATS", 0, _FIND_STATS, _FIND) {
+    DictStats stats;
+
+    dict_get_stats(&stats);
+    output_printf("%zu words in %zu buckets, %"PRIuMAX" lookups, %"PRIuMAX" probes "
+           "(%.2f avg, %"PRIuMAX" max), %"PRIuMAX" resyncs\n",
+           stats.entries, stats.buckets, stats.lookups, stats.probes,
+           stats.lookups ? (double) stats.probes / stats.lookups : 0.0,
+           stats.max_probe, stats.resyncs);
 }
 
 
 // ( addr -- addr )
-PRIMITIVE ("DE>CFA", 0, _DEtoCFA, _FIND) {
+PRIMITIVE ("DE>CFA", 0, _DEtoCFA, _FIND_STATS) {
     REG(a);
 
     DPOP(a);
@@ -1096,13 +988,11 @@ PRIMITIVE ("DFA>CFA", 0, _DFAtoCFA, _DFAtoDE) {
 }
 
 
-// ( -- )
-PRIMITIVE ("LIT", 0, _LIT, _DFAtoCFA) {
-    docolon_mode = DM_LITERAL;
-}
+// ( -- a )
+THREADED ("LIT", 0, _LIT, _DFAtoCFA, OP_LIT);
 
 
-// ( -- addr )
+// ( "name" -- addr )
 PRIMITIVE ("CREATE", 0, _CREATE, _LIT) {
     DictHeader *new_header;
     REG(a);
@@ -1122,6 +1012,7 @@ PRIMITIVE ("CREATE", 0, _CREATE, _LIT) {
     }
 
     // Initialise a DictHeader for it
+    mem_ensure(sizeof(DictHeader) + sizeof(cell) - 1);
     a.as_u = CELLALIGN(var_HERE->as_u);
     new_header = (DictHeader *) a.as_ptr;
     memset(new_header, 0, sizeof(DictHeader));
@@ -1134,6 +1025,7 @@ PRIMITIVE ("CREATE", 0, _CREATE, _LIT) {
     // Update LATEST and HERE
     var_LATEST->as_de = (DictEntry*) new_header;
     var_HERE->as_dfa = DE_to_DFA(new_header);
+    dict_add(var_LATEST->as_de);
 
     // Push DFA
     DPUSH(*var_HERE);
@@ -1145,24 +1037,36 @@ PRIMITIVE (",", 0, _comma, _CREATE) {
     REG(a);
 
     DPOP(a);
+    mem_ensure(sizeof(cell));
     **(cell**)var_HERE = a;
     var_HERE->as_ptr += sizeof(cell);
 }
 
 
+// ( char -- )
+PRIMITIVE ("C,", 0, _Ccomma, _comma) {
+    REG(a);
+
+    DPOP(a);
+    mem_ensure(1);
+    *(char *) var_HERE->as_ptr = a.as_i;
+    var_HERE->as_ptr += 1;
+}
+
+
 // ( -- )
-PRIMITIVE ("[", F_IMMED, _lbrac, _comma) {
-    interpreter_state = S_INTERPRET;
+PRIMITIVE ("[", F_IMMED, _lbrac, _Ccomma) {
+    vm->interpreter_state = S_INTERPRET;
 }
 
 
 // ( -- )
 PRIMITIVE ("]", 0, _rbrac, _lbrac) {
-    interpreter_state = S_COMPILE;
+    vm->interpreter_state = S_COMPILE;
 }
 
 
-// ( -- )
+// ( "name" -- )
 PRIMITIVE (":", 0, _colon, _rbrac) {
     REG(a);
 
@@ -1178,8 +1082,8 @@ PRIMITIVE (":", 0, _colon, _rbrac) {
 
 // ( -- )
 PRIMITIVE (";", F_IMMED | F_COMPONLY, _semicolon, _colon) {
-    DPUSH(*const_EXIT); // FIXME i think this is wrong. XXX ok it's mostly fine, just tricky.
-    _comma(NULL);
+    compile_end();
+    if (var_JIT->as_i)  jit_compile(*(DictEntry **)var_LATEST);  /* else stays threaded */
     DPUSH(*var_LATEST);
     _HIDDEN(NULL);
     _lbrac(NULL);
@@ -1190,6 +1094,7 @@ PRIMITIVE (";", F_IMMED | F_COMPONLY, _semicolon, _colon) {
 PRIMITIVE ("IMMEDIATE", F_IMMED, _IMMEDIATE, _semicolon) {
     DictEntry *latest = *(DictEntry **)var_LATEST;
 
+    if (mem_in_base(latest))  throw(EXC_READONLY);  /* doesn't return */
     latest->flags ^= F_IMMED;
 }
 
@@ -1197,22 +1102,42 @@ PRIMITIVE ("IMMEDIATE", F_IMMED, _IMMEDIATE, _semicolon) {
 // ( -- )
 PRIMITIVE ("COMPILE-ONLY", F_IMMED, _COMPILE_ONLY, _IMMEDIATE) {
     DictEntry *latest = *(DictEntry **)var_LATEST;
-    
+
+    if (mem_in_base(latest))  throw(EXC_READONLY);  /* doesn't return */
     latest->flags ^= F_COMPONLY;
 }
 
 
+// ( -- )
+PRIMITIVE ("INLINE", F_IMMED, _INLINE, _COMPILE_ONLY) {
+    DictEntry *latest = *(DictEntry **)var_LATEST;
+
+    if (mem_in_base(latest))  throw(EXC_READONLY);  /* doesn't return */
+    latest->flags2 ^= F2_INLINE;
+}
+
+
+// ( de -- flag )
+PRIMITIVE ("INLINE?", 0, _INLINEq, _INLINE) {
+    REG(a);
+
+    DPOP(a);
+    DPUSH((cell)(intptr_t)((a.as_de->flags2 & F2_INLINE) != 0));
+}
+
+
 // ( addr -- )
-PRIMITIVE ("HIDDEN", 0, _HIDDEN, _COMPILE_ONLY) {
+PRIMITIVE ("HIDDEN", 0, _HIDDEN, _INLINEq) {
     REG(a);
 
     DPOP(a);
 
+    if (mem_in_base(a.as_de))  throw(EXC_READONLY);  /* doesn't return */
     a.as_de->flags ^= F_HIDDEN;
 }
 
 
-// ( -- )
+// ( "name" -- )
 PRIMITIVE ("HIDE", 0, _HIDE, _HIDDEN) {
     DPUSH((cell)(intptr_t) ' ');
     _WORD(NULL);
@@ -1221,7 +1146,7 @@ PRIMITIVE ("HIDE", 0, _HIDE, _HIDDEN) {
 }
 
 
-// ( -- )
+// ( "name" -- xt )
 PRIMITIVE ("'", 0, _tick, _HIDE) {
     DPUSH((cell)(intptr_t) ' ');
     _WORD(NULL);
@@ -1231,42 +1156,241 @@ PRIMITIVE ("'", 0, _tick, _HIDE) {
 
 
 // ( -- )
-PRIMITIVE ("BRANCH", 0, _BRANCH, _tick) {
-    docolon_mode = DM_BRANCH;
-}
+THREADED ("BRANCH", 0, _BRANCH, _tick, OP_BRANCH);
+
+
+// ( cond -- )
+THREADED ("0BRANCH", 0, _0BRANCH, _BRANCH, OP_0BRANCH);
+
+
+// ( -- addr len )
+THREADED ("LITSTRING", 0, _LITSTRING, _0BRANCH, OP_LITSTRING);
+
+
+/* Superinstructions, which the compiler substitutes for common pairs (see compile.c).  The
+   space in their names means FIND never finds them, and SEE shows the original pair */
+
+// ( a -- a+n )
+THREADED ("LIT +", 0, _LIT_plus, _LITSTRING, OP_LIT_PLUS);
+
+
+// ( addr -- addr a )
+THREADED ("DUP @", 0, _DUP_fetch, _LIT_plus, OP_DUP_FETCH);
+
+
+// ( b a -- b a b a )
+THREADED ("OVER OVER", 0, _OVER_OVER, _DUP_fetch, OP_OVER_OVER);
 
 
 // ( cond -- )
-PRIMITIVE ("0BRANCH", 0, _0BRANCH, _BRANCH) {
+THREADED ("0= 0BRANCH", 0, _zero_equals_0BRANCH, _OVER_OVER, OP_ZERO_EQUALS_0BRANCH);
+
+
+// ( -- flag ) ( R: a -- a )
+THREADED ("R@ 0>", F_COMPONLY, _Rat_zero_gt, _zero_equals_0BRANCH, OP_RAT_ZERO_GT);
+
+
+/* A call just before EXIT, compiled as a jump (see compile_exit) */
+
+// ( -- )
+THREADED ("(TAIL)", F_COMPONLY, _TAIL, _Rat_zero_gt, OP_TAIL);
+
+
+// ( xt -- )
+PRIMITIVE ("COMPILE,", 0, _COMPILE_comma, _TAIL) {
+    REG(xt);
+
+    DPOP(xt);
+    compile_xt(xt.as_xt);
+}
+
+
+// ( -- )
+PRIMITIVE ("EXIT,", 0, _EXIT_comma, _COMPILE_comma) {
+    compile_exit();
+}
+
+
+// ( xt -- kind )  0: nothing, 1: literal, 2: branch offset, 3: counted string, 4: xt
+PRIMITIVE ("XT-ARG", 0, _XT_ARG, _EXIT_comma) {
+    REG(xt);
+
+    DPOP(xt);
+    DPUSH((cell)(intptr_t)(xt.as_xt ? vm_xt_arg(xt.as_xt) : ARG_NONE));
+}
+
+
+// ( n -- )
+PRIMITIVE ("PAIRS", 0, _PAIRS, _XT_ARG) {
+    REG(n);
+
+    DPOP(n);
+    compile_report_pairs(n.as_u);
+}
+
+
+// ( -- )
+PRIMITIVE ("PAIRS-RESET", 0, _PAIRS_RESET, _PAIRS) {
+    compile_reset_pairs();
+}
+
+
+// ( -- )
+PRIMITIVE ("FOLDED", 0, _FOLDED, _PAIRS_RESET) {
+    compile_report_folds();
+}
+
+
+// ( -- )
+PRIMITIVE ("FOLDED-RESET", 0, _FOLDED_RESET, _FOLDED) {
+    compile_reset_folds();
+}
+
+
+// ( xt -- flag )
+PRIMITIVE ("JIT?", 0, _JITq, _FOLDED_RESET) {
+    REG(a);
+
+    DPOP(a);
+    DPUSH((cell)(intptr_t)(jit_contains(*a.as_xt) != 0));
+}
+
+
+// ( de -- in out max flag )  flag is 0, and the rest 0 too, if the effect isn't known
+PRIMITIVE ("STACK-EFFECT", 0, _STACK_EFFECT, _JITq) {
     REG(a);
 
     DPOP(a);
-    if (a.as_i == 0)  docolon_mode = DM_BRANCH;
-    else              docolon_mode = DM_SKIP;
+    if (a.as_de->flags2 & F2_EFFECT) {
+        DPUSH((cell)(intptr_t) a.as_de->effect_in);
+        DPUSH((cell)(intptr_t) a.as_de->effect_out);
+        DPUSH((cell)(intptr_t) a.as_de->effect_max);
+        DPUSH((cell)(intptr_t) 1);
+    }
+    else {
+        DPUSH((cell)(intptr_t) 0);
+        DPUSH((cell)(intptr_t) 0);
+        DPUSH((cell)(intptr_t) 0);
+        DPUSH((cell)(intptr_t) 0);
+    }
+}
+
+
+// ( -- )
+PRIMITIVE ("PROFILE-ON", 0, _PROFILE_ON, _STACK_EFFECT) {
+    profile_start();
+}
+
+
+// ( -- )
+PRIMITIVE ("PROFILE-OFF", 0, _PROFILE_OFF, _PROFILE_ON) {
+    profile_stop();
+}
+
+
+// ( n -- )
+PRIMITIVE ("PROFILE-REPORT", 0, _PROFILE_REPORT, _PROFILE_OFF) {
+    REG(n);
+
+    DPOP(n);
+    profile_report(n.as_u);
 }
 
 
 // ( -- )
-PRIMITIVE ("LITSTRING", 0, _LITSTRING, _0BRANCH) {
-    docolon_mode = DM_SLITERAL;
+PRIMITIVE ("PROFILE-RESET", 0, _PROFILE_RESET, _PROFILE_REPORT) {
+    profile_reset();
+}
+
+
+// ( hz -- )  0 for the default
+PRIMITIVE ("SAMPLE-ON", 0, _SAMPLE_ON, _PROFILE_RESET) {
+    REG(hz);
+
+    DPOP(hz);
+    sample_start(hz.as_i);
+}
+
+
+// ( -- )
+PRIMITIVE ("SAMPLE-OFF", 0, _SAMPLE_OFF, _SAMPLE_ON) {
+    sample_stop();
+}
+
+
+// ( c-addr u -- )  writes folded stacks to the file, or stdout if u is 0
+PRIMITIVE ("SAMPLE-REPORT", 0, _SAMPLE_REPORT, _SAMPLE_OFF) {
+    char path[MAX_PATH_LENGTH];
+
+    pop_path(path);
+
+    if (sample_report(path) != 0) {
+        throw(EXC_FILEIO);  /* doesn't return */
+    }
+}
+
+
+// ( -- )
+PRIMITIVE ("SAMPLE-RESET", 0, _SAMPLE_RESET, _SAMPLE_REPORT) {
+    sample_reset();
+}
+
+
+// ( -- us )  since the epoch
+PRIMITIVE ("UTIME", 0, _UTIME, _SAMPLE_RESET) {
+    DPUSH((cell)(uintptr_t) profile_utime());
+}
+
+
+// ( -- ns )  from some fixed time in the past
+PRIMITIVE ("NS-TIME", 0, _NS_TIME, _UTIME) {
+    DPUSH((cell)(uintptr_t) profile_ns());
+}
+
+
+// ( -- n )  time stamp counter, or NS-TIME if there isn't one
+PRIMITIVE ("CYCLES", 0, _CYCLES, _NS_TIME) {
+    DPUSH((cell)(uintptr_t) profile_ticks());
+}
+
+
+// ( xt n -- )
+PRIMITIVE ("BENCH", 0, _BENCH, _CYCLES) {
+    REG(xt);
+    REG(n);
+
+    DPOP(n);
+    DPOP(xt);
+    vm_check_xt(xt.as_xt);
+    profile_bench(xt.as_xt, n.as_i);
 }
 
 
 // ( addr len -- )
-PRIMITIVE ("TELL", 0, _TELL, _LITSTRING) {
+PRIMITIVE ("TELL", 0, _TELL, _BENCH) {
     REG(a);
     REG(b);
 
     DPOP(a);  // len
     DPOP(b);  // addr
-    while (a.as_u--) {
-        putchar(*((char *) b.as_ptr++));
-    }
+    output_write(b.as_ptr, a.as_u);
+}
+
+
+// ( addr len -- )  the standard name for TELL
+PRIMITIVE ("TYPE", 0, _TYPE, _TELL) {
+    _TELL(NULL);
+}
+
+
+// ( -- )  writes out everything printed so far
+PRIMITIVE ("FLUSH", 0, _FLUSH, _TYPE) {
+    output_flush();
 }
 
 
 // ( -- status )
-PRIMITIVE ("UGROW", 0, _UGROW, _TELL) {
+PRIMITIVE ("UGROW", 0, _UGROW, _FLUSH) {
     REG(a);
 
     a.as_i = mem_grow(var_UINCR->as_u);
@@ -1293,8 +1417,35 @@ PRIMITIVE ("USHRINK", 0, _USHRINK, _UGROWN) {
 }
 
 
+// ( c-addr u -- )
+PRIMITIVE ("SAVE-IMAGE", 0, _SAVE_IMAGE, _USHRINK) {
+    char path[MAX_PATH_LENGTH];
+
+    pop_path(path);
+
+    if (image_save(path) != 0) {
+        throw(EXC_FILEIO);  /* doesn't return */
+    }
+}
+
+
+// ( c-addr u -- )
+PRIMITIVE ("LOAD-IMAGE", 0, _LOAD_IMAGE, _SAVE_IMAGE) {
+    char path[MAX_PATH_LENGTH];
+
+    pop_path(path);
+
+    if (image_load(path) != 0) {
+        throw(EXC_FILEIO);  /* doesn't return */
+    }
+
+    // Whatever called us was in the old region, so there's nothing to return to
+    vm_quit();
+}
+
+
 // ( -- )
-PRIMITIVE ("QUIT", 0, _QUIT, _USHRINK) {
+PRIMITIVE ("QUIT", 0, _QUIT, _LOAD_IMAGE) {
     vm_quit();
 }
 
@@ -1315,7 +1466,7 @@ PRIMITIVE ("breakpoint", F_IMMED, _breakpoint, _ABORT) {
 }
 
 
-// ( a -- a * sizeof(cell))
+// ( n -- bytes )
 PRIMITIVE ("CELLS", 0, _CELLS, _breakpoint) {
     REG(a);
 
@@ -1325,7 +1476,7 @@ PRIMITIVE ("CELLS", 0, _CELLS, _breakpoint) {
 }
 
 
-// (a -- a / sizeof(cell))
+// ( bytes -- n )
 PRIMITIVE ("/CELLS", 0, _divCELLS, _CELLS) {
     REG(a);
     REG(b);
@@ -1337,12 +1488,12 @@ PRIMITIVE ("/CELLS", 0, _divCELLS, _CELLS) {
 }
 
 
-// ( xt -- )
+// ( i*x xt -- j*x )
 PRIMITIVE ("EXECUTE", 0, _EXECUTE, _divCELLS) {
     REG(xt);
 
     DPOP(xt);
-    execute(xt.as_xt);
+    execute_checked(xt.as_xt);
 }
 
 
@@ -1370,7 +1521,7 @@ PRIMITIVE ("POSTPONE", F_IMMED | F_COMPONLY, _POSTPONE, _EXECUTE) {
             _comma(NULL);
             DPUSH((cell) DE_to_CFA(de));
             _comma(NULL);
-            DPUSH((cell) DE_to_CFA(&_dict__comma));
+            DPUSH((cell) DE_to_CFA(&_dict__COMPILE_comma));
             _comma(NULL);
         }
     }
@@ -1382,7 +1533,7 @@ PRIMITIVE ("POSTPONE", F_IMMED | F_COMPONLY, _POSTPONE, _EXECUTE) {
 }
 
 
-// ( n -- )
+// ( n -- )  only returns if n is 0
 PRIMITIVE ("THROW", 0, _THROW, _POSTPONE) {
     REG(n);
 
@@ -1392,7 +1543,7 @@ PRIMITIVE ("THROW", 0, _THROW, _POSTPONE) {
 }
 
 
-// ( xt -- status )
+// ( i*x xt -- j*x 0 | i*x n )
 PRIMITIVE ("CATCH", 0, _CATCH, _THROW) {
     REG(xt);
 
@@ -1402,6 +1553,52 @@ PRIMITIVE ("CATCH", 0, _CATCH, _THROW) {
 }
 
 
+// ( xt -- task )
+PRIMITIVE ("TASK", 0, _TASK, _CATCH) {
+    REG(xt);
+    REG(id);
+
+    DPOP(xt);
+    vm_check_xt(xt.as_xt);
+
+    if ((id.as_i = task_new(xt.as_xt)) < 0) {
+        throw(EXC_DICT_OVER);  /* doesn't return */
+    }
+
+    DPUSH(id);
+}
+
+
+// ( task -- )
+PRIMITIVE ("WAKE", 0, _WAKE, _TASK) {
+    REG(id);
+
+    DPOP(id);
+
+    if (task_wake(id.as_i) != 0) {
+        throw(EXC_ARG);  /* doesn't return */
+    }
+}
+
+
+// ( -- )
+PRIMITIVE ("PAUSE", 0, _PAUSE, _WAKE) {
+    task_pause();
+}
+
+
+// ( -- )
+PRIMITIVE ("STOP", 0, _STOP, _PAUSE) {
+    task_stop();
+}
+
+
+// ( -- n )
+PRIMITIVE ("TASKS", 0, _TASKS, _STOP) {
+    DPUSH((cell)(intptr_t) task_count());
+}
+
+
 /***************************************************************************
     The LATEST variable denotes the top of the dictionary.  Its initial
     value points to its own dictionary entry (tricky).
@@ -1409,4 +1606,4 @@ PRIMITIVE ("CATCH", 0, _CATCH, _THROW) {
     * Be sure to update its link pointer if you add more builtins before it!
     * This must be the LAST entry added to the dictionary!
  ***************************************************************************/
-VARIABLE (LATEST, (intptr_t)&_dict_var_LATEST, 0, _CATCH);  // FIXME keep this updated!
+VARIABLE (LATEST, (intptr_t)&_dict_var_LATEST, 0, _TASKS);  // FIXME keep this updated!
@@ -0,0 +1,371 @@
+#ifndef _BUILTIN_H
+#define _BUILTIN_H
+/* 
+    Generated by genh at Sun Oct 18 03:13:49 2026, from
+      * builtin.c
+*/
+#define var_BASE (&vm->user[USER_BASE])
+#define var_UINCR (&vm->user[USER_UINCR])
+#define var_UTHRES (&vm->user[USER_UTHRES])
+#define var_HERE (&vm->user[USER_HERE])
+#define var_FUSION (&vm->user[USER_FUSION])
+#define var_RSIZE (&vm->user[USER_RSIZE])
+#define var_LEAVES (&vm->user[USER_LEAVES])
+#define var_TAILCALLS (&vm->user[USER_TAILCALLS])
+#define var_AUTOINLINE (&vm->user[USER_AUTOINLINE])
+#define var_FOLDING (&vm->user[USER_FOLDING])
+#define var_JIT (&vm->user[USER_JIT])
+#define var_WARNINGS (&vm->user[USER_WARNINGS])
+extern const cell * const const_VERSION;
+extern const cell * const const_DOCOL;
+extern const cell * const const_DOVAR;
+extern const cell * const const_DOCON;
+extern const cell * const const_DOVAL;
+extern const cell * const const_EXIT;
+extern const cell * const const_F_IMMED;
+extern const cell * const const_F_COMPONLY;
+extern const cell * const const_F_HIDDEN;
+extern const cell * const const_F_LENMASK;
+extern const cell * const const_S_INTERPRET;
+extern const cell * const const_S_COMPILE;
+extern const cell * const const_CELL_MIN;
+extern const cell * const const_CELL_MAX;
+extern const cell * const const_UCELL_MIN;
+extern const cell * const const_UCELL_MAX;
+void readonly_U0 ();
+void readonly_USIZE ();
+void readonly_STATE ();
+extern struct _dict_entry _dict__DROP;
+#define EFFECT__DROP F2_EFFECT, 1, 0, 1
+extern struct _dict_entry _dict__SWAP;
+#define EFFECT__SWAP F2_EFFECT, 2, 2, 2
+extern struct _dict_entry _dict__DUP;
+#define EFFECT__DUP F2_EFFECT, 1, 2, 2
+extern struct _dict_entry _dict__OVER;
+#define EFFECT__OVER F2_EFFECT, 2, 3, 3
+void _TUCK ();
+#define EFFECT__TUCK F2_EFFECT, 2, 3, 3
+void _PICK ();
+#define EFFECT__PICK 0, 0, 0, 0
+void _ROLL ();
+#define EFFECT__ROLL 0, 0, 0, 0
+extern struct _dict_entry _dict__ROT;
+#define EFFECT__ROT F2_EFFECT, 3, 3, 3
+void _negROT ();
+#define EFFECT__negROT F2_EFFECT, 3, 3, 3
+void _2DROP ();
+#define EFFECT__2DROP F2_EFFECT, 2, 0, 2
+void _NDROP ();
+#define EFFECT__NDROP 0, 0, 0, 0
+void _2DUP ();
+#define EFFECT__2DUP F2_EFFECT, 2, 4, 4
+void _NDUP ();
+#define EFFECT__NDUP 0, 0, 0, 0
+void _2SWAP ();
+#define EFFECT__2SWAP F2_EFFECT, 4, 4, 4
+void _qDUP ();
+#define EFFECT__qDUP 0, 0, 0, 0
+extern struct _dict_entry _dict__1plus;
+#define EFFECT__1plus F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__1minus;
+#define EFFECT__1minus F2_EFFECT, 1, 1, 1
+void _4plus ();
+#define EFFECT__4plus F2_EFFECT, 1, 1, 1
+void _4minus ();
+#define EFFECT__4minus F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__plus;
+#define EFFECT__plus F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__minus;
+#define EFFECT__minus F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__multiply;
+#define EFFECT__multiply F2_EFFECT, 2, 1, 2
+void _divide ();
+#define EFFECT__divide F2_EFFECT, 2, 1, 2
+void _modulus ();
+#define EFFECT__modulus F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__equals;
+#define EFFECT__equals F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__notequals;
+#define EFFECT__notequals F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__lt;
+#define EFFECT__lt F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__gt;
+#define EFFECT__gt F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__lte;
+#define EFFECT__lte F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__gte;
+#define EFFECT__gte F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__zero_equals;
+#define EFFECT__zero_equals F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__notzero_equals;
+#define EFFECT__notzero_equals F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__zero_lt;
+#define EFFECT__zero_lt F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__zero_gt;
+#define EFFECT__zero_gt F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__zero_lte;
+#define EFFECT__zero_lte F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__zero_gte;
+#define EFFECT__zero_gte F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__AND;
+#define EFFECT__AND F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__OR;
+#define EFFECT__OR F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__XOR;
+#define EFFECT__XOR F2_EFFECT, 2, 1, 2
+extern struct _dict_entry _dict__INVERT;
+#define EFFECT__INVERT F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__store;
+#define EFFECT__store F2_EFFECT, 2, 0, 2
+extern struct _dict_entry _dict__fetch;
+#define EFFECT__fetch F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__addstore;
+#define EFFECT__addstore F2_EFFECT, 2, 0, 2
+void _substore ();
+#define EFFECT__substore F2_EFFECT, 2, 0, 2
+extern struct _dict_entry _dict__storebyte;
+#define EFFECT__storebyte F2_EFFECT, 2, 0, 2
+extern struct _dict_entry _dict__fetchbyte;
+#define EFFECT__fetchbyte F2_EFFECT, 1, 1, 1
+void _ccopy ();
+#define EFFECT__ccopy F2_EFFECT, 2, 2, 2
+void _cmove ();
+#define EFFECT__cmove F2_EFFECT, 3, 0, 3
+void _ALLOT ();
+#define EFFECT__ALLOT F2_EFFECT, 1, 0, 1
+extern struct _dict_entry _dict__ltR;
+#define EFFECT__ltR F2_EFFECT, 1, 0, 1
+void _2ltR ();
+#define EFFECT__2ltR F2_EFFECT, 2, 0, 2
+extern struct _dict_entry _dict__Rgt;
+#define EFFECT__Rgt F2_EFFECT, 0, 1, 1
+void _2Rgt ();
+#define EFFECT__2Rgt F2_EFFECT, 0, 2, 2
+extern struct _dict_entry _dict__Rat;
+#define EFFECT__Rat F2_EFFECT, 0, 1, 1
+void _2Rat ();
+#define EFFECT__2Rat F2_EFFECT, 0, 2, 2
+void _R1plus ();
+#define EFFECT__R1plus F2_EFFECT, 0, 0, 0
+void _R1minus ();
+#define EFFECT__R1minus F2_EFFECT, 0, 0, 0
+extern struct _dict_entry _dict__paren_DO;
+#define EFFECT__paren_DO F2_EFFECT, 2, 0, 2
+extern struct _dict_entry _dict__paren_qDO;
+#define EFFECT__paren_qDO F2_EFFECT, 2, 0, 2
+extern struct _dict_entry _dict__paren_LOOP;
+#define EFFECT__paren_LOOP F2_EFFECT, 0, 0, 0
+extern struct _dict_entry _dict__paren_plusLOOP;
+#define EFFECT__paren_plusLOOP F2_EFFECT, 1, 0, 1
+extern struct _dict_entry _dict__I;
+#define EFFECT__I F2_EFFECT, 0, 1, 1
+extern struct _dict_entry _dict__J;
+#define EFFECT__J F2_EFFECT, 0, 1, 1
+extern struct _dict_entry _dict__UNLOOP;
+#define EFFECT__UNLOOP F2_EFFECT, 0, 0, 0
+void _gtCTRL ();
+#define EFFECT__gtCTRL F2_EFFECT, 1, 0, 1
+void _2gtCTRL ();
+#define EFFECT__2gtCTRL F2_EFFECT, 2, 0, 2
+void _CTRLgt ();
+#define EFFECT__CTRLgt F2_EFFECT, 0, 1, 1
+void _2CTRLgt ();
+#define EFFECT__2CTRLgt F2_EFFECT, 0, 2, 2
+void _CTRLat ();
+#define EFFECT__CTRLat F2_EFFECT, 0, 1, 1
+void _2CTRLat ();
+#define EFFECT__2CTRLat F2_EFFECT, 0, 2, 2
+void _ASSERT ();
+#define EFFECT__ASSERT 0, 0, 0, 0
+void _dotS ();
+#define EFFECT__dotS F2_EFFECT, 0, 0, 0
+void _KEY ();
+#define EFFECT__KEY F2_EFFECT, 0, 1, 1
+void _EMIT ();
+#define EFFECT__EMIT F2_EFFECT, 1, 0, 1
+void _WORD ();
+#define EFFECT__WORD F2_EFFECT, 1, 1, 1
+void _SOURCE ();
+#define EFFECT__SOURCE F2_EFFECT, 0, 2, 2
+void _toIN ();
+#define EFFECT__toIN F2_EFFECT, 0, 1, 1
+void _REFILL ();
+#define EFFECT__REFILL F2_EFFECT, 0, 1, 1
+void _PARSE_NAME ();
+#define EFFECT__PARSE_NAME F2_EFFECT, 0, 2, 2
+void _INCLUDE_FILE ();
+#define EFFECT__INCLUDE_FILE 0, 0, 0, 0
+void _INCLUDED ();
+#define EFFECT__INCLUDED 0, 0, 0, 0
+void _NUMBER ();
+#define EFFECT__NUMBER F2_EFFECT, 1, 2, 2
+void _UdotR ();
+#define EFFECT__UdotR F2_EFFECT, 2, 0, 2
+void _dotR ();
+#define EFFECT__dotR F2_EFFECT, 2, 0, 2
+void _FIND ();
+#define EFFECT__FIND F2_EFFECT, 1, 1, 1
+void _FIND_STATS ();
+#define EFFECT__FIND_STATS F2_EFFECT, 0, 0, 0
+void _DEtoCFA ();
+#define EFFECT__DEtoCFA F2_EFFECT, 1, 1, 1
+void _DEtoDFA ();
+#define EFFECT__DEtoDFA F2_EFFECT, 1, 1, 1
+void _DEtoNAME ();
+#define EFFECT__DEtoNAME F2_EFFECT, 1, 1, 1
+void _DFAtoDE ();
+#define EFFECT__DFAtoDE F2_EFFECT, 1, 1, 1
+void _DFAtoCFA ();
+#define EFFECT__DFAtoCFA F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__LIT;
+#define EFFECT__LIT F2_EFFECT, 0, 1, 1
+void _CREATE ();
+#define EFFECT__CREATE F2_EFFECT, 0, 1, 1
+void _comma ();
+#define EFFECT__comma F2_EFFECT, 1, 0, 1
+void _Ccomma ();
+#define EFFECT__Ccomma F2_EFFECT, 1, 0, 1
+void _lbrac ();
+#define EFFECT__lbrac F2_EFFECT, 0, 0, 0
+void _rbrac ();
+#define EFFECT__rbrac F2_EFFECT, 0, 0, 0
+void _colon ();
+#define EFFECT__colon F2_EFFECT, 0, 0, 0
+void _semicolon ();
+#define EFFECT__semicolon F2_EFFECT, 0, 0, 0
+void _IMMEDIATE ();
+#define EFFECT__IMMEDIATE F2_EFFECT, 0, 0, 0
+void _COMPILE_ONLY ();
+#define EFFECT__COMPILE_ONLY F2_EFFECT, 0, 0, 0
+void _INLINE ();
+#define EFFECT__INLINE F2_EFFECT, 0, 0, 0
+void _INLINEq ();
+#define EFFECT__INLINEq F2_EFFECT, 1, 1, 1
+void _HIDDEN ();
+#define EFFECT__HIDDEN F2_EFFECT, 1, 0, 1
+void _HIDE ();
+#define EFFECT__HIDE F2_EFFECT, 0, 0, 0
+void _tick ();
+#define EFFECT__tick F2_EFFECT, 0, 1, 1
+extern struct _dict_entry _dict__BRANCH;
+#define EFFECT__BRANCH F2_EFFECT, 0, 0, 0
+extern struct _dict_entry _dict__0BRANCH;
+#define EFFECT__0BRANCH F2_EFFECT, 1, 0, 1
+extern struct _dict_entry _dict__LITSTRING;
+#define EFFECT__LITSTRING F2_EFFECT, 0, 2, 2
+extern struct _dict_entry _dict__LIT_plus;
+#define EFFECT__LIT_plus F2_EFFECT, 1, 1, 1
+extern struct _dict_entry _dict__DUP_fetch;
+#define EFFECT__DUP_fetch F2_EFFECT, 1, 2, 2
+extern struct _dict_entry _dict__OVER_OVER;
+#define EFFECT__OVER_OVER F2_EFFECT, 2, 4, 4
+extern struct _dict_entry _dict__zero_equals_0BRANCH;
+#define EFFECT__zero_equals_0BRANCH F2_EFFECT, 1, 0, 1
+extern struct _dict_entry _dict__Rat_zero_gt;
+#define EFFECT__Rat_zero_gt F2_EFFECT, 0, 1, 1
+extern struct _dict_entry _dict__TAIL;
+#define EFFECT__TAIL F2_EFFECT, 0, 0, 0
+void _COMPILE_comma ();
+#define EFFECT__COMPILE_comma F2_EFFECT, 1, 0, 1
+void _EXIT_comma ();
+#define EFFECT__EXIT_comma F2_EFFECT, 0, 0, 0
+void _XT_ARG ();
+#define EFFECT__XT_ARG F2_EFFECT, 1, 1, 1
+void _PAIRS ();
+#define EFFECT__PAIRS F2_EFFECT, 1, 0, 1
+void _PAIRS_RESET ();
+#define EFFECT__PAIRS_RESET F2_EFFECT, 0, 0, 0
+void _FOLDED ();
+#define EFFECT__FOLDED F2_EFFECT, 0, 0, 0
+void _FOLDED_RESET ();
+#define EFFECT__FOLDED_RESET F2_EFFECT, 0, 0, 0
+void _JITq ();
+#define EFFECT__JITq F2_EFFECT, 1, 1, 1
+void _STACK_EFFECT ();
+#define EFFECT__STACK_EFFECT F2_EFFECT, 1, 4, 4
+void _PROFILE_ON ();
+#define EFFECT__PROFILE_ON F2_EFFECT, 0, 0, 0
+void _PROFILE_OFF ();
+#define EFFECT__PROFILE_OFF F2_EFFECT, 0, 0, 0
+void _PROFILE_REPORT ();
+#define EFFECT__PROFILE_REPORT F2_EFFECT, 1, 0, 1
+void _PROFILE_RESET ();
+#define EFFECT__PROFILE_RESET F2_EFFECT, 0, 0, 0
+void _SAMPLE_ON ();
+#define EFFECT__SAMPLE_ON F2_EFFECT, 1, 0, 1
+void _SAMPLE_OFF ();
+#define EFFECT__SAMPLE_OFF F2_EFFECT, 0, 0, 0
+void _SAMPLE_REPORT ();
+#define EFFECT__SAMPLE_REPORT F2_EFFECT, 2, 0, 2
+void _SAMPLE_RESET ();
+#define EFFECT__SAMPLE_RESET F2_EFFECT, 0, 0, 0
+void _UTIME ();
+#define EFFECT__UTIME F2_EFFECT, 0, 1, 1
+void _NS_TIME ();
+#define EFFECT__NS_TIME F2_EFFECT, 0, 1, 1
+void _CYCLES ();
+#define EFFECT__CYCLES F2_EFFECT, 0, 1, 1
+void _BENCH ();
+#define EFFECT__BENCH F2_EFFECT, 2, 0, 2
+void _TELL ();
+#define EFFECT__TELL F2_EFFECT, 2, 0, 2
+void _TYPE ();
+#define EFFECT__TYPE F2_EFFECT, 2, 0, 2
+void _FLUSH ();
+#define EFFECT__FLUSH F2_EFFECT, 0, 0, 0
+void _UGROW ();
+#define EFFECT__UGROW F2_EFFECT, 0, 1, 1
+void _UGROWN ();
+#define EFFECT__UGROWN F2_EFFECT, 1, 1, 1
+void _USHRINK ();
+#define EFFECT__USHRINK F2_EFFECT, 1, 1, 1
+void _SAVE_IMAGE ();
+#define EFFECT__SAVE_IMAGE F2_EFFECT, 2, 0, 2
+void _LOAD_IMAGE ();
+#define EFFECT__LOAD_IMAGE F2_EFFECT, 2, 0, 2
+void _QUIT ();
+#define EFFECT__QUIT F2_EFFECT, 0, 0, 0
+void _ABORT ();
+#define EFFECT__ABORT F2_EFFECT, 0, 0, 0
+void _breakpoint ();
+#define EFFECT__breakpoint F2_EFFECT, 0, 0, 0
+void _CELLS ();
+#define EFFECT__CELLS F2_EFFECT, 1, 1, 1
+void _divCELLS ();
+#define EFFECT__divCELLS F2_EFFECT, 1, 1, 1
+void _EXECUTE ();
+#define EFFECT__EXECUTE 0, 0, 0, 0
+void _POSTPONE ();
+#define EFFECT__POSTPONE F2_EFFECT, 0, 0, 0
+void _THROW ();
+#define EFFECT__THROW F2_EFFECT, 1, 0, 1
+void _CATCH ();
+#define EFFECT__CATCH 0, 0, 0, 0
+void _TASK ();
+#define EFFECT__TASK F2_EFFECT, 1, 1, 1
+void _WAKE ();
+#define EFFECT__WAKE F2_EFFECT, 1, 0, 1
+void _PAUSE ();
+#define EFFECT__PAUSE F2_EFFECT, 0, 0, 0
+void _STOP ();
+#define EFFECT__STOP F2_EFFECT, 0, 0, 0
+void _TASKS ();
+#define EFFECT__TASKS F2_EFFECT, 0, 1, 1
+#define var_LATEST (&vm->user[USER_LATEST])
+enum {
+    USER_BASE,
+    USER_UINCR,
+    USER_UTHRES,
+    USER_HERE,
+    USER_FUSION,
+    USER_RSIZE,
+    USER_LEAVES,
+    USER_TAILCALLS,
+    USER_AUTOINLINE,
+    USER_FOLDING,
+    USER_JIT,
+    USER_WARNINGS,
+    USER_LATEST,
+    USER_COUNT
+};
+#endif /* _BUILTIN_H */
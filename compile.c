@@ -0,0 +1,1053 @@
+/*
+
+  Compiling xts into colon definitions.
+
+  Everything the outer interpreter compiles, and everything compiled with COMPILE, (which
+  POSTPONE now uses for non-immediate words), goes through compile_xt().  Raw `,` still
+  just stores a cell.
+
+  compile_xt() keeps a window onto the last few xts it compiled.  If the next xt makes a
+  pair with the last of them that's in the rules table below, the first xt is rewritten in
+  place as the superinstruction for the pair, and the second is never written.  Inline arguments stay
+  where they are: at most one member of a pair may take one, and if it's the first member
+  it has already been written, while if it's the second it hasn't been yet.
+
+  The window only stays open while nothing but compile_xt() and inline arguments have
+  been written since, so any raw `,` closes it.  It is also closed after every immediate
+  word that runs in compile state, since those are the ones that take HERE as a branch
+  target (BEGIN, THEN etc), and fusing across a branch target would be wrong.  An immediate
+  word may still compile with COMPILE, before it takes HERE -- IF does exactly this, which
+  is how `0= IF` becomes `0= 0BRANCH` -- but not after.
+
+  Fusion can be turned off by storing 0 in FUSION.
+
+  EXIT (and `;`, after compile_end() below) are compiled by compile_exit().  If the last thing in the definition so far
+  is a call to a colon definition, it becomes (TAIL) xt, which jumps to xt without pushing a
+  return address, so xt returns straight to our caller and tail recursion runs in constant
+  return stack.  The EXIT is still compiled after it, for SEE and anything else that scans
+  a definition.  Branches can already target HERE (`IF ... RECURSE THEN ;`), which is now
+  where the xt goes, so rather than trust the window, compile_exit() walks the definition
+  from the start to find the last call, and moves any branch to HERE on to the EXIT.  If
+  the walk doesn't come out exactly at HERE (something was compiled with a raw `,` that it
+  can't step over) it leaves well alone.  Tail calls can be turned off by storing 0 in
+  TAILCALLS.
+
+  A colon definition flagged INLINE (or, if AUTOINLINE is set, one no longer than that many
+  cells) isn't called at all: compile_xt() copies its body in instead, instruction by
+  instruction, through compile_xt() again so that fusion and nested inlining still apply.
+  Inline arguments go along with their instructions, LITSTRING's included.  Branch offsets
+  are relative, but instructions can change size on the way (fusion, and an EXIT in the
+  middle of the body becoming a BRANCH to the end of the copy; a (TAIL) xt becomes a plain
+  call), so they are patched once everything is in place.  Fusion is kept from merging
+  anything into an instruction that's branched to.  Since the copy is just more code in
+  the caller, and the flag lives in the header, MARKER rolls them back like anything else.
+
+  The window also lets compile_xt() work out at compile time what the code would only ever
+  compute the same way at run time.  It holds the last few instructions, so an operator
+  whose operands are all literals just compiled (`LIT 3 LIT 4 +`, or `3 4 +` in the
+  source) is run there and then, and the literals are replaced by a literal of the result.
+  The operators it can do that for are in the folds table below: those that don't touch
+  anything but the data stack, and don't leave more on it than they take.  Pairs that
+  undo each other (DUP DROP, SWAP SWAP...) are both dropped, as is a literal that's
+  dropped, and `LIT 0 0BRANCH` is a plain BRANCH.  A CONSTANT is compiled as a literal of
+  its value, so it can take part in all this.  Since the window is closed at branch
+  targets, nothing is ever folded across one.
+
+  Some things can't be done until the whole definition is there, so `;` calls
+  compile_end(), which walks it from the start, following the branches from one place to
+  the next.  A literal that's branched on (which compile_xt() has to leave if the literal
+  isn't 0, since the branch offset hasn't been compiled yet) is removed along with its
+  0BRANCH, or the 0BRANCH becomes a BRANCH; code that can't be reached is removed; and so
+  are branches that would only go to the next instruction anyway.  What's left is moved up
+  and the branches adjusted, before compile_exit() looks for a tail call.
+
+  All of this can be turned off by storing 0 in FOLDING.  FOLDED lists how many cells
+  folding, cancelling and pruning removed from each definition, and FOLDED-RESET forgets.
+  What they don't count is what a definition grows by: the extra cell a CONSTANT takes as a
+  literal, and whatever is inlined (though what's removed from an inlined copy counts).
+
+  Last, compile_end() works out the definition's stack effect: how many cells it takes from
+  the data stack, how many it leaves, and how many of its own it ever has there at once.
+  Every builtin's effect is in its dictionary entry (genh reads them from the stack comments
+  in builtin.c), and variables and constants push one cell, so it follows every path
+  through the body, as prune() does, adding them up.  A call to the definition itself
+  is taken to have the effect the other paths give it, which is then checked by going
+  round again.  If anything it calls has no known effect (EXECUTE, PICK, ?DUP...) the
+  definition doesn't either.  If two paths meet with different depths, or it leaves
+  something on the return stack, it's unbalanced, and unless WARNINGS is 0 it says so
+  (except for IMMEDIATE words, which can take different things in different states, and
+  INLINE ones, which are only fragments of the words they're copied into).
+  Words that call it can then be worked out in turn, and the JIT checks the data stack
+  once on the way in to a word whose effect is known, rather than at every instruction.
+  STACK-EFFECT gives what it found.
+
+  Building with -DVM_PROFILE_PAIRS (make PAIRS=1) makes do_colon count every pair of xts
+  it runs back to back, and PAIRS reports the most frequent, as candidates for new rules.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "forth.h"
+#include "vm.h"
+#include "compile.h"
+
+#define PAIR_TABLE_SIZE     (1 << 14)   /* must be a power of 2 */
+#define MAX_INLINE_CELLS    (256)       /* longest definition INLINE will copy */
+#define MAX_INLINE_DEPTH    (8)         /* inline words inlined within inline words... */
+#define MAX_FOLD_NAME       (31)        /* F_LENMASK */
+#define MAX_EFFECT_PASSES   (8)         /* rounds to settle a recursive word's effect */
+
+typedef struct _fuse_rule {
+    DictEntry   *first;
+    DictEntry   *second;
+    DictEntry   *fused;
+} FuseRule;
+
+typedef struct _fold_rule {
+    DictEntry   *op;        /* its stack effect says how many literals it takes and leaves */
+    int         divides;    /* by the top one, which mustn't be 0 or -1 */
+} FoldRule;
+
+typedef struct _cancel_rule {
+    DictEntry   *first;
+    DictEntry   *second;
+} CancelRule;
+
+typedef struct _fold_count {
+    char        name[MAX_FOLD_NAME];
+    uint8_t     length;
+    intptr_t    saved;
+} FoldCount;
+
+typedef struct _fixup {
+    cell        *at;        /* branch offset in the copy */
+    size_t      to;         /* offset into the original of where it went */
+} Fixup;
+
+typedef struct _effect {
+    int         in;         /* cells taken from the data stack */
+    int         out;        /* and left there */
+    int         max;        /* most there at once, counting those taken */
+} Effect;
+
+enum { EFFECT_OK = 0, EFFECT_UNKNOWN, EFFECT_UNBALANCED };
+
+typedef struct _walk {
+    cell        *start;     /* of the body */
+    cell        *end;
+    struct _depth {
+        int32_t data;       /* cells on the data stack, from where it started */
+        int32_t ret;        /* cells it has put on the return stack */
+        int     seen;
+    }           *at;        /* one per cell of the body */
+    size_t      *todo;      /* offsets of instructions reached but not yet followed */
+    size_t      ntodo;
+    const char  *why;       /* if EFFECT_UNBALANCED */
+} Walk;
+
+typedef struct _pair_count {
+    const pvf   *first;
+    const pvf   *second;
+    uintmax_t   count;
+} PairCount;
+
+/* These are copied from builtin.h/builtin.c, for easy reference while reading */
+extern DictEntry _dict__LIT, _dict__plus, _dict__DUP, _dict__fetch, _dict__OVER,
+    _dict__zero_equals, _dict__0BRANCH, _dict__Rat, _dict__zero_gt;
+extern DictEntry _dict__LIT_plus, _dict__DUP_fetch, _dict__OVER_OVER,
+    _dict__zero_equals_0BRANCH, _dict__Rat_zero_gt;
+extern DictEntry _dict__TAIL, _dict__BRANCH, _dict__2Rat, _dict__R1plus, _dict__R1minus;
+extern DictEntry _dict__DROP, _dict__SWAP, _dict__ROT, _dict__negROT, _dict__2DROP,
+    _dict__2DUP, _dict__ltR, _dict__Rgt, _dict__2ltR, _dict__2Rgt, _dict__1plus,
+    _dict__1minus, _dict__4plus, _dict__4minus, _dict__minus, _dict__multiply, _dict__divide,
+    _dict__modulus, _dict__equals, _dict__notequals, _dict__lt, _dict__gt, _dict__lte,
+    _dict__gte, _dict__notzero_equals, _dict__zero_lt, _dict__zero_lte, _dict__zero_gte,
+    _dict__AND, _dict__OR, _dict__XOR, _dict__INVERT, _dict__CELLS, _dict__divCELLS;
+
+static const FuseRule rules[] = {
+    { &_dict__LIT,          &_dict__plus,       &_dict__LIT_plus },
+    { &_dict__DUP,          &_dict__fetch,      &_dict__DUP_fetch },
+    { &_dict__OVER,         &_dict__OVER,       &_dict__OVER_OVER },
+    { &_dict__zero_equals,  &_dict__0BRANCH,    &_dict__zero_equals_0BRANCH },
+    { &_dict__Rat,          &_dict__zero_gt,    &_dict__Rat_zero_gt },
+};
+
+static const FoldRule folds[] = {
+    { &_dict__1plus,            0 },
+    { &_dict__1minus,           0 },
+    { &_dict__4plus,            0 },
+    { &_dict__4minus,           0 },
+    { &_dict__zero_equals,      0 },
+    { &_dict__notzero_equals,   0 },
+    { &_dict__zero_lt,          0 },
+    { &_dict__zero_gt,          0 },
+    { &_dict__zero_lte,         0 },
+    { &_dict__zero_gte,         0 },
+    { &_dict__INVERT,           0 },
+    { &_dict__CELLS,            0 },
+    { &_dict__divCELLS,         0 },
+    { &_dict__plus,             0 },
+    { &_dict__minus,            0 },
+    { &_dict__multiply,         0 },
+    { &_dict__divide,           1 },
+    { &_dict__modulus,          1 },
+    { &_dict__equals,           0 },
+    { &_dict__notequals,        0 },
+    { &_dict__lt,               0 },
+    { &_dict__gt,               0 },
+    { &_dict__lte,              0 },
+    { &_dict__gte,              0 },
+    { &_dict__AND,              0 },
+    { &_dict__OR,               0 },
+    { &_dict__XOR,              0 },
+    { &_dict__DROP,             0 },
+    { &_dict__2DROP,            0 },
+    { &_dict__SWAP,             0 },
+    { &_dict__ROT,              0 },
+    { &_dict__negROT,           0 },
+};
+
+static const CancelRule cancels[] = {
+    { &_dict__DUP,          &_dict__DROP },
+    { &_dict__OVER,         &_dict__DROP },
+    { &_dict__2DUP,         &_dict__2DROP },
+    { &_dict__SWAP,         &_dict__SWAP },
+    { &_dict__ROT,          &_dict__negROT },
+    { &_dict__negROT,       &_dict__ROT },
+    { &_dict__ltR,          &_dict__Rgt },
+    { &_dict__2ltR,         &_dict__2Rgt },
+};
+
+/* Private state, one per VM (see CompileState in compile.h) */
+#define recent          (vm->compile.recent)
+#define nrecent         (vm->compile.nrecent)
+#define pairs           (vm->compile.pairs)
+#define pairs_dropped   (vm->compile.pairs_dropped)
+#define folding         (vm->compile.folding)
+#define removed         (vm->compile.removed)
+#define fold_counts     (vm->compile.folds)
+#define nfolds          (vm->compile.nfolds)
+#define folds_capacity  (vm->compile.folds_capacity)
+
+
+static const FuseRule *find_rule (const pvf *first, const pvf *second) {
+    for (size_t i = 0; i < sizeof(rules) / sizeof(rules[0]); i++) {
+        if (DE_to_CFA(rules[i].first) == first && DE_to_CFA(rules[i].second) == second)
+            return &rules[i];
+    }
+    return NULL;
+}
+
+
+static const FoldRule *find_fold (const pvf *op) {
+    for (size_t i = 0; i < sizeof(folds) / sizeof(folds[0]); i++) {
+        if (DE_to_CFA(folds[i].op) == op)  return &folds[i];
+    }
+    return NULL;
+}
+
+
+static const CancelRule *find_cancel (const pvf *first, const pvf *second) {
+    for (size_t i = 0; i < sizeof(cancels) / sizeof(cancels[0]); i++) {
+        if (DE_to_CFA(cancels[i].first) == first && DE_to_CFA(cancels[i].second) == second)
+            return &cancels[i];
+    }
+    return NULL;
+}
+
+
+// Frees the pair and fold counts, if there were any
+void compile_destroy () {
+    free(pairs);
+    pairs = NULL;
+    pairs_dropped = 0;
+    free(fold_counts);
+    fold_counts = NULL;
+    nfolds = folds_capacity = 0;
+    folding = NULL;
+    removed = 0;
+    nrecent = 0;
+}
+
+
+static void compile (const pvf *xt, int depth);
+static cell *next_instruction (cell *p);
+
+
+static void compile_cell (cell value) {
+    mem_ensure(sizeof(cell));
+    *var_HERE->as_dfa = value;
+    var_HERE->as_dfa++;
+}
+
+
+// The final EXIT of the colon definition starting at start: the first one no branch goes
+// past.  NULL if there's something in the way that isn't an instruction, or it's too long
+static cell *definition_end (cell *start, size_t max) {
+    cell *p = start, *reach = start, *next;
+
+    while ((size_t)(p - start) <= max && (next = next_instruction(p)) != NULL) {
+        if (p->as_xt == NULL) {
+            if (p >= reach)  return p;
+        }
+        else if (vm_xt_arg(p->as_xt) == ARG_BRANCH && p + 1 + p[1].as_i > reach) {
+            reach = p + 1 + p[1].as_i;
+        }
+        p = next;
+    }
+    return NULL;
+}
+
+
+// Where xt's body ends if it should be inlined rather than called, otherwise NULL
+static cell *inline_end (const pvf *xt, int depth) {
+    DictEntry *de = CFA_to_DE(xt);
+    size_t max;
+
+    if ((*xt != do_colon && !jit_contains(*xt))  /* a JIT'd word keeps its threaded body */
+        || depth >= MAX_INLINE_DEPTH || de == var_LATEST->as_de)
+        return NULL;
+
+    if (de->flags2 & F2_INLINE)
+        max = MAX_INLINE_CELLS;
+    else if (var_AUTOINLINE->as_i > 0 && !(de->flags & F_IMMED))
+        max = var_AUTOINLINE->as_u;
+    else
+        return NULL;
+
+    return definition_end(CFA_to_DFA(xt), max);
+}
+
+
+// Copies xt's body, up to end, in at HERE.  Returns 0, or -1 if there wasn't the memory to
+// keep track, in which case nothing has been compiled
+static int compile_inline (const pvf *self, cell *end, int depth) {
+    cell *start = CFA_to_DFA(self);
+    size_t n = end - start + 1, nfixups = 0;
+    cell **moved = calloc(n, sizeof(*moved));       // where each instruction went
+    char *target = calloc(n, sizeof(*target));      // whether anything branches to it
+    Fixup *fixups = calloc(n, sizeof(*fixups));
+    cell *p, *next;
+
+    if (moved == NULL || target == NULL || fixups == NULL) {
+        free(moved);
+        free(target);
+        free(fixups);
+        return -1;
+    }
+
+    for (p = start; p < end; p = next_instruction(p)) {
+        if (p->as_xt == NULL)
+            target[n - 1] = 1;
+        else if (vm_xt_arg(p->as_xt) == ARG_BRANCH)
+            target[p + 1 + p[1].as_i - start] = 1;
+    }
+
+    for (p = start; p < end; p = next) {
+        const pvf *xt = p->as_xt;
+
+        next = next_instruction(p);
+        if (target[p - start])  nrecent = 0;
+        moved[p - start] = var_HERE->as_dfa;
+
+        if (xt == NULL) {
+            // EXIT from the middle of the body carries on after the copy instead, which
+            // right before the end it would anyway
+            if (next == end)  continue;
+            compile(DE_to_CFA(&_dict__BRANCH), depth);
+            fixups[nfixups++] = (Fixup) { var_HERE->as_dfa, n - 1 };
+            compile_cell((cell)(intptr_t) 0);
+        }
+        else if (xt == DE_to_CFA(&_dict__TAIL)) {
+            compile(p[1].as_xt, p[1].as_xt == self ? MAX_INLINE_DEPTH : depth);
+        }
+        else {
+            compile(xt, xt == self ? MAX_INLINE_DEPTH : depth);  // recursion is still a call
+            switch (vm_xt_arg(xt)) {
+                case ARG_NONE:
+                    break;
+                case ARG_BRANCH:
+                    fixups[nfixups++] = (Fixup) { var_HERE->as_dfa, p + 1 + p[1].as_i - start };
+                    compile_cell((cell)(intptr_t) 0);
+                    break;
+                case ARG_STRING:
+                    for (cell *q = p + 1; q < next; q++)  compile_cell(*q);
+                    break;
+                default:
+                    compile_cell(p[1]);
+                    break;
+            }
+        }
+    }
+
+    if (target[n - 1])  nrecent = 0;
+    moved[n - 1] = var_HERE->as_dfa;
+
+    for (size_t i = 0; i < nfixups; i++)
+        fixups[i].at->as_i = moved[fixups[i].to] - fixups[i].at;
+
+    free(moved);
+    free(target);
+    free(fixups);
+    return 0;
+}
+
+
+// Compiles xt at HERE, fusing it with the previous one if possible
+void compile_xt (const pvf *xt) {
+    compile(xt, 0);
+}
+
+
+// The last instruction in the window, if it's still open: nothing has been written since
+// but its own inline argument
+static cell *last_compiled () {
+    cell *last;
+
+    if (nrecent == 0)  return NULL;
+
+    last = recent[nrecent - 1];
+    if (var_HERE->as_dfa != last + 1 + (vm_xt_arg(last->as_xt) != ARG_NONE)) {
+        nrecent = 0;
+        return NULL;
+    }
+    return last;
+}
+
+
+static int is_literal (const cell *p) {
+    return p->as_xt == DE_to_CFA(&_dict__LIT);
+}
+
+
+// Counts n cells removed from the definition being compiled
+static void count_removed (intptr_t n) {
+    if (folding != var_LATEST->as_de) {
+        folding = var_LATEST->as_de;
+        removed = 0;
+    }
+    removed += n;
+}
+
+
+// Takes the last n instructions in the window back out of the dictionary
+static void uncompile (size_t n) {
+    nrecent -= n;
+    var_HERE->as_dfa = recent[nrecent];
+}
+
+
+// Runs op on the literals at the end of the window, and compiles what it leaves as literals
+// in their place.  Returns 0, or -1 if they aren't all literals
+static int fold (const FoldRule *rule, int depth) {
+    int in = rule->op->effect_in, out = rule->op->effect_out;
+    cell result[3];
+    int i;
+
+    if (last_compiled() == NULL || nrecent < (size_t) in)  return -1;
+
+    for (i = 1; i <= in; i++) {
+        if (!is_literal(recent[nrecent - i]))  return -1;
+    }
+    if (rule->divides && (recent[nrecent - 1][1].as_i == 0 || recent[nrecent - 1][1].as_i == -1))
+        return -1;
+
+    for (i = in; i > 0; i--)  DPUSH(recent[nrecent - i][1]);
+    execute(DE_to_CFA(rule->op));
+    for (i = out; i > 0; i--)  DPOP(result[i - 1]);
+
+    uncompile(in);
+    for (i = 0; i < out; i++) {
+        compile(DE_to_CFA(&_dict__LIT), depth);
+        compile_cell(result[i]);
+    }
+    count_removed(2 * in + 1 - 2 * out);
+    return 0;
+}
+
+
+static void compile (const pvf *xt, int depth) {
+    cell *here, *last;
+    InlineArg arg;
+    cell *end;
+
+    if ((end = inline_end(xt, depth)) != NULL && compile_inline(xt, end, depth + 1) == 0)
+        return;
+
+    if (var_FOLDING->as_i) {
+        const FoldRule *rule;
+
+        if (*xt == do_constant) {
+            compile(DE_to_CFA(&_dict__LIT), depth);
+            compile_cell(*CFA_to_DFA(xt));
+            return;
+        }
+
+        if ((rule = find_fold(xt)) != NULL && fold(rule, depth) == 0)
+            return;
+
+        if ((last = last_compiled()) != NULL && find_cancel(last->as_xt, xt)) {
+            uncompile(1);
+            count_removed(2);
+            return;
+        }
+
+        if (xt == DE_to_CFA(&_dict__0BRANCH) && (last = last_compiled()) != NULL
+            && is_literal(last) && last[1].as_i == 0) {
+            uncompile(1);
+            count_removed(2);
+            xt = DE_to_CFA(&_dict__BRANCH);
+        }
+    }
+
+    if (var_FUSION->as_i && (last = last_compiled()) != NULL) {
+        const FuseRule *rule = find_rule(last->as_xt, xt);
+        if (rule) {
+            last->as_xt = DE_to_CFA(rule->fused);
+            return;
+        }
+    }
+
+    last_compiled();  // closes the window if something's been written since
+
+    here = var_HERE->as_dfa;
+    arg = vm_xt_arg(xt);
+    mem_ensure(sizeof(cell));
+    here->as_xt = (pvf *) xt;
+    var_HERE->as_dfa = here + 1;
+
+    if (arg == ARG_STRING) {
+        // the length isn't known yet, so there's no telling where the string will end
+        nrecent = 0;
+    }
+    else {
+        if (nrecent == MAX_RECENT)  memmove(recent, recent + 1, --nrecent * sizeof(*recent));
+        recent[nrecent++] = here;
+    }
+}
+
+
+// Steps over the instruction at p in a colon definition.  NULL if p doesn't hold an xt
+static cell *next_instruction (cell *p) {
+    const pvf *xt = p->as_xt;
+
+    if (xt == NULL)  return p + 1;  /* EXIT */
+    if (!dict_contains(CFA_to_DE(xt)))  return NULL;
+
+    switch (vm_xt_arg(xt)) {
+        case ARG_NONE:      return p + 1;
+        case ARG_STRING:    return p + 2 + CELLALIGN(p[1].as_u) / sizeof(cell);
+        default:            return p + 2;
+    }
+}
+
+
+// The call to a colon definition that ends the definition being compiled, if it does
+static cell *find_tail_call (cell *start, cell *here) {
+    cell *p = start, *last = NULL;
+
+    while (p && p < here) {
+        last = p;
+        p = next_instruction(p);
+    }
+
+    if (p != here || last == NULL || last + 1 != here
+        || last->as_xt == NULL || *last->as_xt != do_colon)
+        return NULL;
+    return last;
+}
+
+
+// Points every branch in [start, end) that goes to from at to instead
+static void retarget (cell *start, cell *end, const cell *from, const cell *to) {
+    for (cell *p = start; p < end; p = next_instruction(p)) {
+        if (p->as_xt && vm_xt_arg(p->as_xt) == ARG_BRANCH && p + 1 + p[1].as_i == from)
+            p[1].as_i = to - (p + 1);
+    }
+}
+
+
+// Compiles EXIT at HERE, turning a call just before it into a tail call if possible
+void compile_exit () {
+    cell *here = var_HERE->as_dfa;
+    DictEntry *latest = var_LATEST->as_de;
+    cell *start = DE_to_DFA(latest), *call = NULL;
+
+    if (var_TAILCALLS->as_i && latest->code == do_colon && start < here)
+        call = find_tail_call(start, here);
+
+    if (call) {
+        mem_ensure(2 * sizeof(cell));
+        retarget(start, call, here, here + 1);
+        here->as_xt = call->as_xt;
+        call->as_xt = DE_to_CFA(&_dict__TAIL);
+        here++;
+    }
+    else {
+        mem_ensure(sizeof(cell));
+    }
+
+    here->as_xt = NULL;
+    var_HERE->as_dfa = here + 1;
+    nrecent = 0;
+}
+
+
+// Removes what can never run from the colon definition in [start, here), branches on
+// literals, and branches to where the code would go anyway, and moves what's left up to
+// close the gaps.  Returns the number of cells removed
+static size_t prune (cell *start, cell *here) {
+    enum { INSN = 0x01, TARGET = 0x02, REACHED = 0x04, DROPPED = 0x08 };
+    size_t n = here - start + 1, nstarts = 0, nwork = 0, kept, i, saved = 0;
+    char *kind = calloc(n, sizeof(*kind));          // what's at each cell
+    size_t *starts = calloc(n, sizeof(*starts));    // where each instruction is
+    size_t *work = calloc(2 * n, sizeof(*work));    // reached, but not followed yet
+    size_t *after = calloc(n, sizeof(*after));      // the first one kept from there on
+    cell **moved = calloc(n, sizeof(*moved));       // where each one kept goes
+    cell *p, *next, *q;
+
+    if (kind == NULL || starts == NULL || work == NULL || after == NULL || moved == NULL)
+        goto done;
+
+    for (p = start; p < here; p = next) {
+        if ((next = next_instruction(p)) == NULL)  goto done;
+        kind[p - start] |= INSN;
+        starts[nstarts++] = p - start;
+    }
+    if (p != here)  goto done;
+    kind[n - 1] |= INSN;  // where the EXIT goes
+
+    for (i = 0; i < nstarts; i++) {
+        p = start + starts[i];
+        if (p->as_xt && vm_xt_arg(p->as_xt) == ARG_BRANCH) {
+            q = p + 1 + p[1].as_i;
+            if (q < start || q > here || !(kind[q - start] & INSN))  goto done;
+            kind[q - start] |= TARGET;
+        }
+    }
+
+    // A literal branched on, unless something else branches to the branch
+    for (i = 0; i + 1 < nstarts; i++) {
+        p = start + starts[i];
+        next = start + starts[i + 1];
+        if (is_literal(p) && next->as_xt == DE_to_CFA(&_dict__0BRANCH)
+            && !(kind[next - start] & TARGET)) {
+            kind[p - start] |= DROPPED;
+            if (p[1].as_i)  kind[next - start] |= DROPPED;
+            else  next->as_xt = DE_to_CFA(&_dict__BRANCH);
+        }
+    }
+
+    // Follow the code from the start, to find what can run
+    work[nwork++] = 0;
+    while (nwork > 0) {
+        i = work[--nwork];
+        if (i == n - 1 || (kind[i] & REACHED))  continue;
+        kind[i] |= REACHED;
+
+        p = start + i;
+        next = next_instruction(p);
+        if (!(kind[i] & DROPPED)) {
+            if (p->as_xt == NULL)  continue;  // the EXIT after a (TAIL) stays, though
+            if (vm_xt_arg(p->as_xt) == ARG_BRANCH) {
+                work[nwork++] = p + 1 + p[1].as_i - start;
+                if (p->as_xt == DE_to_CFA(&_dict__BRANCH))  continue;
+            }
+        }
+        work[nwork++] = next - start;
+    }
+
+    // Working backwards, so it's known what's kept after each branch
+    after[n - 1] = kept = n - 1;
+    for (i = nstarts; i-- > 0; ) {
+        size_t at = starts[i];
+
+        p = start + at;
+        if (!(kind[at] & REACHED)) {
+            kind[at] |= DROPPED;
+        }
+        else if (!(kind[at] & DROPPED) && p->as_xt == DE_to_CFA(&_dict__BRANCH)) {
+            size_t to = p + 1 + p[1].as_i - start;
+            if (to > at && after[to] == kept)  kind[at] |= DROPPED;
+        }
+
+        if (!(kind[at] & DROPPED))  kept = at;
+        else  saved = 1;
+        after[at] = kept;
+    }
+    if (!saved)  goto done;
+
+    for (i = 0, q = start; i < nstarts; i++) {
+        size_t at = starts[i], end = i + 1 < nstarts ? starts[i + 1] : n - 1;
+        if (!(kind[at] & DROPPED)) {
+            moved[at] = q;
+            q += end - at;
+        }
+    }
+    moved[n - 1] = q;
+
+    for (i = 0; i < nstarts; i++) {
+        size_t at = starts[i], end = i + 1 < nstarts ? starts[i + 1] : n - 1, to = n;
+
+        if (kind[at] & DROPPED)  continue;
+        p = start + at;
+        if (p->as_xt && vm_xt_arg(p->as_xt) == ARG_BRANCH)
+            to = after[p + 1 + p[1].as_i - start];
+        memmove(moved[at], p, (end - at) * sizeof(cell));
+        if (to < n)
+            moved[at][1].as_i = moved[to] - (moved[at] + 1);
+    }
+
+    var_HERE->as_dfa = moved[n - 1];
+    saved = here - moved[n - 1];
+
+done:
+    free(kind);
+    free(starts);
+    free(work);
+    free(after);
+    free(moved);
+    return saved;
+}
+
+
+static void count_fold (const DictEntry *de, intptr_t n) {
+    FoldCount *f;
+
+    if (nfolds == folds_capacity) {
+        size_t new_capacity = folds_capacity ? 2 * folds_capacity : 64;
+        FoldCount *new_counts = realloc(fold_counts, new_capacity * sizeof(*fold_counts));
+        if (new_counts == NULL)  return;  // it's only statistics
+        fold_counts = new_counts;
+        folds_capacity = new_capacity;
+    }
+
+    f = &fold_counts[nfolds++];
+    f->length = de->flags & F_LENMASK;
+    memcpy(f->name, de->name, f->length);
+    f->saved = n;
+}
+
+
+// What xt takes from the data stack and leaves there.  0, or -1 if that isn't known
+static int data_effect (const pvf *xt, int *in, int *out) {
+    DictEntry *de = CFA_to_DE(xt);
+    cell *mem = mem_get_start();
+
+    if (*xt == do_variable || *xt == do_constant || *xt == do_user || *xt == do_value) {
+        *in = 0;
+        *out = 1;
+        return 0;
+    }
+
+    // A definition's effect is only good for as long as it has the code it was worked out for
+    if (!(de->flags2 & F2_EFFECT)
+        || ((cell *) de >= mem && (cell *) de < mem + mem_get_ncells()
+            && *xt != do_colon && !jit_contains(*xt)))
+        return -1;
+
+    *in = de->effect_in;
+    *out = de->effect_out;
+    return 0;
+}
+
+
+// How many cells xt needs on the return stack, and how many more or fewer it leaves there
+// (for LOOP and +LOOP, once the loop's done)
+static void return_effect (const pvf *xt, int *need, int *delta) {
+    DictEntry *de = CFA_to_DE(xt);
+
+    *need = *delta = 0;
+    if (*xt == do_threaded) {
+        switch ((CFA_to_DFA(xt))->as_i) {
+            case OP_LTR:            *delta = 1;  break;
+            case OP_RGT:            *need = 1;  *delta = -1;  break;
+            case OP_RAT:
+            case OP_RAT_ZERO_GT:    *need = 1;  break;
+            case OP_DO:
+            case OP_QDO:            *delta = 2;  break;
+            case OP_LOOP:
+            case OP_PLUSLOOP:
+            case OP_UNLOOP:         *need = 2;  *delta = -2;  break;
+            case OP_I:              *need = 2;  break;
+            case OP_J:              *need = 4;  break;
+        }
+    }
+    else if (de == &_dict__2ltR)  *delta = 2;
+    else if (de == &_dict__2Rgt)  { *need = 2;  *delta = -2; }
+    else if (de == &_dict__2Rat)  *need = 2;
+    else if (de == &_dict__R1plus || de == &_dict__R1minus)  *need = 1;
+}
+
+
+// Notes that p is reached with the stacks at those depths, to be followed from there
+static int reach (Walk *w, cell *p, int data, int ret) {
+    struct _depth *at;
+
+    if (p < w->start || p >= w->end)  return EFFECT_UNKNOWN;
+
+    at = &w->at[p - w->start];
+    if (!at->seen) {
+        at->seen = 1;
+        at->data = data;
+        at->ret = ret;
+        w->todo[w->ntodo++] = p - w->start;
+        return EFFECT_OK;
+    }
+    if (at->data == data && at->ret == ret)  return EFFECT_OK;
+
+    w->why = at->data != data ? "has paths that meet with different data stack depths"
+                              : "has paths that meet with different return stack depths";
+    return EFFECT_UNBALANCED;
+}
+
+
+// Follows every path through the body of de, [start, end), adding up effects.  A call to de
+// itself has the effect self, or is taken never to return if self is NULL.  *recursive is
+// set if there is one
+static int walk (DictEntry *de, cell *start, cell *end, const Effect *self, Effect *e,
+                 int *recursive, const char **why) {
+    Walk w = { start, end, calloc(end - start, sizeof(*w.at)),
+               malloc((end - start) * sizeof(*w.todo)), 0, NULL };
+    int low = 0, high = 0, exits = 0, exit_data = 0, status = EFFECT_UNKNOWN;
+
+    if (w.at && w.todo)  status = reach(&w, start, 0, 0);
+
+    while (status == EFFECT_OK && w.ntodo > 0) {
+        cell *p = start + w.todo[--w.ntodo], *next = next_instruction(p);
+        const pvf *xt = p->as_xt, *callee;
+        int data = w.at[p - start].data, ret = w.at[p - start].ret, in, out, need, delta;
+
+        if (next == NULL) {
+            status = EFFECT_UNKNOWN;
+            break;
+        }
+
+        if (xt == NULL) {   /* EXIT */
+            if (ret != 0) {
+                w.why = "leaves cells on the return stack";
+                status = EFFECT_UNBALANCED;
+            }
+            else if (exits++ > 0 && data != exit_data) {
+                w.why = "exits with different data stack depths";
+                status = EFFECT_UNBALANCED;
+            }
+            exit_data = data;
+            continue;
+        }
+
+        callee = (*xt == do_threaded && (CFA_to_DFA(xt))->as_i == OP_TAIL) ? p[1].as_xt : xt;
+        if (CFA_to_DE(callee) == de) {
+            *recursive = 1;
+            if (self == NULL)  continue;
+            in = self->in;
+            out = self->out;
+        }
+        else if (data_effect(callee, &in, &out) != 0) {
+            status = EFFECT_UNKNOWN;
+            break;
+        }
+        if (data - in < low)  low = data - in;
+        data += out - in;
+        if (data > high)  high = data;
+
+        return_effect(xt, &need, &delta);
+        if (ret < need) {   /* at its caller's, which is none of our business */
+            status = EFFECT_UNKNOWN;
+            break;
+        }
+
+        if (vm_xt_arg(xt) != ARG_BRANCH) {
+            status = reach(&w, next, data, ret + delta);
+            continue;
+        }
+
+        // Anything but BRANCH may also carry on: 0BRANCH, ?DO going into the loop rather than
+        // skipping it, and LOOP leaving it rather than going round again
+        status = reach(&w, p + 1 + p[1].as_i, data, ret);
+        if (status == EFFECT_OK && (CFA_to_DFA(xt))->as_i != OP_BRANCH)
+            status = reach(&w, next, data, ret + delta);
+    }
+
+    if (status == EFFECT_UNBALANCED)  *why = w.why;
+    else if (status == EFFECT_OK && exits == 0)  status = EFFECT_UNKNOWN;  /* never returns */
+
+    e->in = -low;
+    e->out = exit_data - low;
+    e->max = high - low;
+    if (e->in > UINT8_MAX || e->out > UINT8_MAX || e->max > UINT8_MAX)  status = EFFECT_UNKNOWN;
+
+    free(w.at);
+    free(w.todo);
+    return status;
+}
+
+
+// Works out the stack effect of de, a colon definition with body [start, end), and records
+// it in de if it can.  Says so if the definition is unbalanced
+static void infer_effect (DictEntry *de, cell *start, cell *end) {
+    Effect e, self;
+    const char *why = NULL;
+    int status, recursive = 0, pass;
+
+    de->flags2 &= ~F2_EFFECT;
+    if (start >= end)  return;
+
+    status = walk(de, start, end, NULL, &e, &recursive, &why);
+    for (pass = 0; recursive && status == EFFECT_OK; pass++) {
+        if (pass == MAX_EFFECT_PASSES) {
+            status = EFFECT_UNKNOWN;
+            break;
+        }
+        self = e;
+        status = walk(de, start, end, &self, &e, &recursive, &why);
+        if (e.in == self.in && e.out == self.out)  break;
+    }
+
+    if (status == EFFECT_OK) {
+        de->flags2 |= F2_EFFECT;
+        de->effect_in = e.in;
+        de->effect_out = e.out;
+        de->effect_max = e.max;
+    }
+    else if (status == EFFECT_UNBALANCED && var_WARNINGS->as_i
+             && !(de->flags & F_IMMED) && !(de->flags2 & F2_INLINE)) {
+        fprintf(stderr, "warning: %.*s %s\n", de->flags & F_LENMASK, de->name, why);
+    }
+}
+
+
+// Finishes the colon definition being compiled, for `;`
+void compile_end () {
+    DictEntry *latest = var_LATEST->as_de;
+    cell *start = DE_to_DFA(latest), *here = var_HERE->as_dfa;
+
+    if (var_FOLDING->as_i && latest->code == do_colon && start < here)
+        count_removed(prune(start, here));
+
+    compile_exit();
+    if (latest->code == do_colon)  infer_effect(latest, start, var_HERE->as_dfa);
+
+    if (folding == latest && removed != 0)  count_fold(latest, removed);
+    folding = NULL;
+    removed = 0;
+}
+
+
+// Stops the next xt compiled from being fused with the last one
+void compile_barrier () {
+    nrecent = 0;
+}
+
+
+// Called by do_colon for every xt it runs, when built with -DVM_PROFILE_PAIRS
+void compile_count_pair (const pvf *first, const pvf *second) {
+    register size_t h, i;
+
+    if (first == NULL)  return;
+
+    if (pairs == NULL && (pairs = calloc(PAIR_TABLE_SIZE, sizeof(*pairs))) == NULL) {
+        pairs_dropped++;
+        return;
+    }
+
+    h = (((uintptr_t) first >> 3) * 31 + ((uintptr_t) second >> 3)) & (PAIR_TABLE_SIZE - 1);
+    for (i = 0; i < PAIR_TABLE_SIZE; i++, h = (h + 1) & (PAIR_TABLE_SIZE - 1)) {
+        if (pairs[h].first == first && pairs[h].second == second) {
+            pairs[h].count++;
+            return;
+        }
+        if (pairs[h].first == NULL) {
+            pairs[h].first = first;
+            pairs[h].second = second;
+            pairs[h].count = 1;
+            return;
+        }
+    }
+
+    pairs_dropped++;  // table's full
+}
+
+
+static int compare_pairs (const void *a, const void *b) {
+    uintmax_t ca = ((const PairCount *) a)->count;
+    uintmax_t cb = ((const PairCount *) b)->count;
+    return (ca < cb) - (ca > cb);
+}
+
+
+// Could first and second be made into a superinstruction without changing the compiler?
+static int fusable (const pvf *first, const pvf *second) {
+    InlineArg a = vm_xt_arg(first), b = vm_xt_arg(second);
+
+    return *first == do_threaded && *second == do_threaded
+        && a != ARG_STRING && b != ARG_STRING
+        && (a == ARG_NONE || b == ARG_NONE);
+}
+
+
+static void print_xt_name (const pvf *xt, int width) {
+    DictEntry *de = CFA_to_DE(xt);
+    output_printf("%-*.*s", width, de->flags & F_LENMASK, de->name);
+}
+
+
+// Prints the n most frequently run pairs.  Those marked * could be made superinstructions
+void compile_report_pairs (size_t n) {
+    PairCount *sorted;
+    size_t count = 0;
+
+    if (pairs == NULL) {
+        output_printf("no pairs counted (pair profiling needs make PAIRS=1)\n");
+        return;
+    }
+
+    if ((sorted = malloc(PAIR_TABLE_SIZE * sizeof(*sorted))) == NULL) {
+        perror("PAIRS");
+        return;
+    }
+
+    for (size_t i = 0; i < PAIR_TABLE_SIZE; i++) {
+        if (pairs[i].first)  sorted[count++] = pairs[i];
+    }
+    qsort(sorted, count, sizeof(*sorted), compare_pairs);
+
+    for (size_t i = 0; i < count && i < n; i++) {
+        output_printf("%12ju %c ", sorted[i].count,
+            fusable(sorted[i].first, sorted[i].second) ? '*' : ' ');
+        print_xt_name(sorted[i].first, F_LENMASK);
+        output_char(' ');
+        print_xt_name(sorted[i].second, 0);
+        output_char('\n');
+    }
+    if (pairs_dropped)  output_printf("(%ju not counted, table full)\n", pairs_dropped);
+
+    free(sorted);
+}
+
+
+void compile_reset_pairs () {
+    if (pairs)  memset(pairs, 0, PAIR_TABLE_SIZE * sizeof(*pairs));
+    pairs_dropped = 0;
+}
+
+
+// Prints how many cells folding has removed from each definition, since the last FOLDED-RESET
+void compile_report_folds () {
+    intmax_t total = 0;
+
+    for (size_t i = 0; i < nfolds; i++) {
+        output_printf("%8jd %.*s\n", (intmax_t) fold_counts[i].saved,
+            fold_counts[i].length, fold_counts[i].name);
+        total += fold_counts[i].saved;
+    }
+    output_printf("%8jd total, in %zu definitions\n", total, nfolds);
+}
+
+
+void compile_reset_folds () {
+    nfolds = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef _COMPILE_H
+#define _COMPILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_RECENT      (4)
+
+struct _pair_count;
+struct _fold_count;
+struct _dict_entry;
+
+typedef struct _compile_state {
+    cell        *recent[MAX_RECENT];    /* the last few instructions compiled, oldest first */
+    size_t      nrecent;                /* 0 once the window onto them is closed */
+    struct _pair_count *pairs;
+    uintmax_t   pairs_dropped;
+    struct _dict_entry *folding;        /* the definition removed is counting for */
+    intptr_t    removed;                /* cells the peephole optimiser has removed from it */
+    struct _fold_count *folds;          /* for FOLDED */
+    size_t      nfolds;
+    size_t      folds_capacity;
+} CompileState;
+
+void compile_destroy ();
+void compile_xt (const pvf *xt);
+void compile_exit ();
+void compile_end ();
+void compile_barrier ();
+void compile_count_pair (const pvf *first, const pvf *second);
+void compile_report_pairs (size_t n);
+void compile_reset_pairs ();
+void compile_report_folds ();
+void compile_reset_folds ();
+
+
+#endif /* _COMPILE_H */
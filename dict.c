@@ -0,0 +1,350 @@
+/*
+
+  Hashed name index over the dictionary, used by FIND.
+
+  The linked list from LATEST down to __ROOT remains the authoritative dictionary; this is
+  purely an accelerator for it.  Every entry is recorded in order[] (oldest first), and
+  threaded onto the chain for its name's hash bucket, newest first.  A lookup therefore
+  sees the same definition a walk of the linked list would: the newest one that isn't
+  F_HIDDEN.  Flags are read from the DictEntry itself at lookup time, so HIDDEN and
+  IMMEDIATE never leave the index stale.
+
+  The same entries are also hashed by address, so dict_contains() can cheaply vouch for an
+  execution token that came from somewhere untrusted (EXECUTE, CATCH) without probing memory
+  that may not be ours.
+
+  CREATE adds its new entry with dict_add().  Anything that rewrites LATEST directly (MARKER,
+  for one) is caught by dict_sync() on the next lookup: the index is either popped back to
+  the new LATEST, extended up to it, or failing that, rebuilt from scratch.
+
+  Each VM has an index of its own.  Once a base dictionary has been shared (see vm_share()),
+  its index is shared too, and a VM's own index only covers the entries above where its
+  dictionary joins the base -- its overlay.  A lookup searches the overlay first, then the
+  base, ignoring anything in the base newer than the join (which a MARKER in the base can
+  move down).
+
+*/
+
+#include <stdio.h>  /* fprintf */
+#include <stdlib.h> /* malloc, realloc */
+#include <string.h>
+
+#include "forth.h"
+#include "dict.h"
+
+#define INIT_DICT_BUCKETS   (256)   /* must be a power of 2 */
+#define NO_ENTRY            (-1)
+
+/* These are copied from builtin.h/builtin.c, for easy reference while reading */
+extern DictEntry _dict___ROOT;
+
+/* The shared base's index, if there is one.  It never changes once made, see dict_share() */
+static DictIndex    *shared = NULL;
+
+
+// FNV-1a
+static inline uint32_t dict_hash (const char *name, size_t len) {
+    register uint32_t h = 2166136261u;
+    while (len--) {
+        h ^= (unsigned char) *name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+static inline size_t dict_addr_hash (const DictEntry *de) {
+    register uintptr_t h = (uintptr_t) de;
+    return (h >> 4) ^ (h >> 16);
+}
+
+
+static inline void dict_thread (DictIndex *d, size_t i) {
+    size_t b = d->hashes[i] & (d->nbuckets - 1);
+    d->chain[i] = d->name_buckets[b];
+    d->name_buckets[b] = i;
+
+    b = dict_addr_hash(d->order[i]) & (d->nbuckets - 1);
+    d->addr_chain[i] = d->addr_buckets[b];
+    d->addr_buckets[b] = i;
+}
+
+
+static void dict_rehash (DictIndex *d, size_t new_nbuckets) {
+    int32_t *new_buckets = malloc(new_nbuckets * sizeof(*new_buckets));
+    int32_t *new_addr_buckets = malloc(new_nbuckets * sizeof(*new_addr_buckets));
+    if (new_buckets == NULL || new_addr_buckets == NULL) {
+        // keep the old, more crowded, tables -- lookups still work
+        fprintf(stderr, "dict_rehash: malloc for %zu buckets failed\n", new_nbuckets);
+        free(new_buckets);
+        free(new_addr_buckets);
+        return;
+    }
+
+    free(d->name_buckets);
+    free(d->addr_buckets);
+    d->name_buckets = new_buckets;
+    d->addr_buckets = new_addr_buckets;
+    d->nbuckets = new_nbuckets;
+    for (size_t i = 0; i < d->nbuckets; i++)  d->name_buckets[i] = d->addr_buckets[i] = NO_ENTRY;
+
+    // oldest first, so the newest entry ends up at the head of each chain
+    for (size_t i = 0; i < d->count; i++)  dict_thread(d, i);
+}
+
+
+static void dict_reserve (DictIndex *d, size_t n) {
+    if (n <= d->capacity)  return;
+
+    size_t new_capacity = d->capacity ? d->capacity : INIT_DICT_BUCKETS;
+    while (new_capacity < n)  new_capacity *= 2;
+
+    DictEntry **new_order = realloc(d->order, new_capacity * sizeof(*d->order));
+    uint32_t *new_hashes = realloc(d->hashes, new_capacity * sizeof(*d->hashes));
+    int32_t *new_chain = realloc(d->chain, new_capacity * sizeof(*d->chain));
+    int32_t *new_addr_chain = realloc(d->addr_chain, new_capacity * sizeof(*d->addr_chain));
+
+    // any that did succeed are still valid, and big enough for what they hold
+    if (new_order)  d->order = new_order;
+    if (new_hashes)  d->hashes = new_hashes;
+    if (new_chain)  d->chain = new_chain;
+    if (new_addr_chain)  d->addr_chain = new_addr_chain;
+
+    if (!new_order || !new_hashes || !new_chain || !new_addr_chain) {
+        fprintf(stderr, "dict_reserve: realloc for %zu entries failed\n", new_capacity);
+        throw(EXC_DICT_OVER);  /* doesn't return */
+    }
+    d->capacity = new_capacity;
+}
+
+
+// Index the n entries from latest downwards, which must sit directly on top of order[count-1]
+static void dict_extend (DictIndex *d, DictEntry *latest, size_t n) {
+    DictEntry *de = latest;
+    size_t top = d->count + n;
+
+    dict_reserve(d, top);
+
+    for (size_t i = top; i > d->count; i--, de = de->link)  d->order[i - 1] = de;
+
+    for ( ; d->count < top; d->count++) {
+        de = d->order[d->count];
+        d->hashes[d->count] = dict_hash(de->name, de->flags & F_LENMASK);
+        if (d->nbuckets)  dict_thread(d, d->count);
+    }
+
+    if (d->count > d->nbuckets) {
+        size_t new_nbuckets = d->nbuckets ? d->nbuckets : INIT_DICT_BUCKETS;
+        while (new_nbuckets < d->count)  new_nbuckets *= 2;
+        dict_rehash(d, new_nbuckets);
+    }
+}
+
+
+// Only ever removes the newest entry, which is necessarily at the head of its chains
+static void dict_pop (DictIndex *d) {
+    size_t i = --d->count;
+    d->name_buckets[d->hashes[i] & (d->nbuckets - 1)] = d->chain[i];
+    d->addr_buckets[dict_addr_hash(d->order[i]) & (d->nbuckets - 1)] = d->addr_chain[i];
+}
+
+
+// Where de is in d, ignoring anything newer than top; or NO_ENTRY
+static int32_t dict_position (const DictIndex *d, const DictEntry *de, int32_t top) {
+    register int32_t i;
+
+    if (d->nbuckets == 0)  return NO_ENTRY;
+
+    for (i = d->addr_buckets[dict_addr_hash(de) & (d->nbuckets - 1)]; i != NO_ENTRY; i = d->addr_chain[i]) {
+        if (i <= top && d->order[i] == de)  return i;
+    }
+
+    return NO_ENTRY;
+}
+
+
+// The newest non-hidden entry in d called name, ignoring anything newer than top; or NULL
+static DictEntry *dict_lookup (const DictIndex *d, const char *name, size_t len, uint32_t h,
+                               int32_t top, uintmax_t *probes) {
+    register int32_t i;
+
+    if (d->nbuckets == 0)  return NULL;
+
+    for (i = d->name_buckets[h & (d->nbuckets - 1)]; i != NO_ENTRY; i = d->chain[i]) {
+        register DictEntry *de = d->order[i];
+        ++*probes;
+        if (i <= top
+            && d->hashes[i] == h
+            && (de->flags & (F_HIDDEN | F_LENMASK)) == len
+            && memcmp(name, de->name, len) == 0) {
+            return de;
+        }
+    }
+
+    return NULL;
+}
+
+
+// The newest entry d covers: the top of its own entries, or failing that, where it joins the base
+static DictEntry *dict_top (const DictIndex *d) {
+    if (d->count)  return d->order[d->count - 1];
+    if (d->shared_top != NO_ENTRY)  return shared->order[d->shared_top];
+    return NULL;
+}
+
+
+// Index everything from LATEST down to __ROOT, or to the first entry that's in the shared base
+static void dict_rebuild (DictIndex *d) {
+    DictEntry *de;
+    size_t n = 0;
+
+    d->shared_top = NO_ENTRY;
+    for (de = var_LATEST->as_de; de && de != &_dict___ROOT; de = de->link, n++) {
+        if (shared && (d->shared_top = dict_position(shared, de, shared->count - 1)) != NO_ENTRY)
+            break;
+    }
+
+    d->count = 0;
+    for (size_t i = 0; i < d->nbuckets; i++)  d->name_buckets[i] = d->addr_buckets[i] = NO_ENTRY;
+    dict_extend(d, var_LATEST->as_de, n);
+}
+
+
+// Bring the index into line with LATEST, if something has changed it behind our back
+static void dict_sync (DictIndex *d) {
+    DictEntry *latest = var_LATEST->as_de;
+    DictEntry *de, *top;
+    int32_t i;
+    size_t n;
+
+    d->stats.resyncs++;
+    d->latest = latest;
+
+    // Rolled back, e.g. by a MARKER?
+    for (n = d->count; n > 0; n--) {
+        if (d->order[n - 1] == latest) {
+            while (d->count > n)  dict_pop(d);
+            return;
+        }
+    }
+
+    // ... all the way back into the shared base?  Then everything of our own is forgotten
+    if (shared && d->shared_top != NO_ENTRY
+        && (i = dict_position(shared, latest, d->shared_top)) != NO_ENTRY) {
+        while (d->count > 0)  dict_pop(d);
+        d->shared_top = i;
+        mem_check_here();
+        return;
+    }
+
+    // Extended without going through CREATE?  Then the old top is somewhere beneath LATEST
+    if ((top = dict_top(d)) != NULL) {
+        for (n = 0, de = latest; de && de != &_dict___ROOT; de = de->link, n++) {
+            if (de == top) {
+                dict_extend(d, latest, n);
+                return;
+            }
+        }
+    }
+
+    // Anything else, start over
+    dict_rebuild(d);
+}
+
+
+// Build the index from whatever LATEST currently points to
+void dict_init () {
+    dict_destroy();
+    dict_sync(&vm->dict);
+}
+
+
+void dict_destroy () {
+    DictIndex *d = &vm->dict;
+
+    free(d->order);
+    free(d->hashes);
+    free(d->chain);
+    free(d->addr_chain);
+    free(d->name_buckets);
+    free(d->addr_buckets);
+
+    memset(d, 0, sizeof(*d));
+    d->shared_top = NO_ENTRY;
+}
+
+
+/*
+  Hands this VM's index over to be the shared base's, which every VM searches after its own
+  entries from then on.  This VM carries on with an empty index of its own on top of it.
+  Only one base can be shared, and only before any other VM has been made.
+*/
+void dict_share () {
+    DictIndex *d = &vm->dict;
+
+    if (d->latest != var_LATEST->as_de)  dict_sync(d);
+
+    if ((shared = malloc(sizeof(*shared))) == NULL) {
+        perror("dict_share");
+        exit(1);
+    }
+    *shared = *d;
+
+    memset(d, 0, sizeof(*d));
+    d->shared_top = (int32_t) shared->count - 1;
+    d->latest = var_LATEST->as_de;
+}
+
+
+// Call right after linking a new entry in at LATEST
+void dict_add (DictEntry *de) {
+    DictIndex *d = &vm->dict;
+
+    if (d->latest != de->link)  dict_sync(d);
+    else  dict_extend(d, de, 1);
+    d->latest = de;
+}
+
+
+// Returns the newest non-hidden entry called name, or NULL
+DictEntry *dict_find (const char *name, size_t len) {
+    DictIndex *d = &vm->dict;
+    uintmax_t probes = 0;
+    DictEntry *result = NULL;
+    uint32_t h;
+
+    if (d->latest != var_LATEST->as_de)  dict_sync(d);
+
+    if (len > F_LENMASK)  return NULL;
+
+    h = dict_hash(name, len);
+    result = dict_lookup(d, name, len, h, (int32_t) d->count - 1, &probes);
+    if (result == NULL && d->shared_top != NO_ENTRY)
+        result = dict_lookup(shared, name, len, h, d->shared_top, &probes);
+
+    d->stats.lookups++;
+    d->stats.probes += probes;
+    if (probes > d->stats.max_probe)  d->stats.max_probe = probes;
+
+    return result;
+}
+
+
+// Returns true if de is an entry in the dictionary (hidden or not)
+int dict_contains (const DictEntry *de) {
+    DictIndex *d = &vm->dict;
+
+    if (d->latest != var_LATEST->as_de)  dict_sync(d);
+
+    return dict_position(d, de, (int32_t) d->count - 1) != NO_ENTRY
+        || (d->shared_top != NO_ENTRY && dict_position(shared, de, d->shared_top) != NO_ENTRY);
+}
+
+
+void dict_get_stats (DictStats *s) {
+    DictIndex *d = &vm->dict;
+
+    *s = d->stats;
+    s->entries = d->count + (d->shared_top + 1);
+    s->buckets = d->nbuckets;
+}
@@ -0,0 +1,43 @@
+#ifndef _DICT_H
+#define _DICT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct _dict_entry;
+
+typedef struct _dict_stats {
+    size_t      entries;
+    size_t      buckets;
+    uintmax_t   lookups;
+    uintmax_t   probes;
+    uintmax_t   max_probe;
+    uintmax_t   resyncs;
+} DictStats;
+
+/* The index's private state, one per VM.  See dict.c */
+typedef struct _dict_index {
+    struct _dict_entry **order;     /* every indexed entry, oldest first */
+    uint32_t    *hashes;            /* hash of order[i]'s name */
+    int32_t     *chain;             /* next older entry in the same bucket */
+    size_t      count;
+    size_t      capacity;
+    int32_t     *addr_chain;        /* next older entry in the same address bucket */
+    int32_t     *name_buckets;      /* newest entry in each bucket */
+    int32_t     *addr_buckets;
+    size_t      nbuckets;
+    int32_t     shared_top;         /* newest entry of the shared base in view, or -1 */
+    struct _dict_entry *latest;     /* LATEST, as of the last time the index was brought up to date */
+    struct _dict_stats stats;
+} DictIndex;
+
+void dict_init ();
+void dict_destroy ();
+void dict_share ();
+void dict_add (struct _dict_entry *de);
+struct _dict_entry *dict_find (const char *name, size_t len);
+int  dict_contains (const struct _dict_entry *de);
+void dict_get_stats (DictStats *stats);
+
+
+#endif /* _DICT_H */
@@ -1,16 +1,14 @@
 #include <string.h>
 
+#include "forth.h"
 #include "exception.h"
 
 #ifndef STACK_EMPTY
 #define STACK_EMPTY (-1)
 #endif
 
-static struct {
-    int32_t top;
-#define EXCEPTION_STACK_SIZE (32)
-    ExceptionFrame values[EXCEPTION_STACK_SIZE];
-} exception_stack;
+/* Each task has its own exception stack */
+#define exception_stack (vm->task->exceptions)
 
 void exception_init() {
     memset(&exception_stack, 0, sizeof(exception_stack));
@@ -6,11 +6,18 @@
 
 typedef struct _exception_frame {
     jmp_buf target;
-    int16_t ds_top;
-    int16_t rs_top;
-    int16_t cs_top;
+    int32_t ds_top;
+    int32_t rs_top;
+    int32_t cs_top;
+    int32_t input_depth;
 } ExceptionFrame;
 
+#define EXCEPTION_STACK_SIZE (32)
+typedef struct _exception_stack {
+    int32_t top;
+    ExceptionFrame values[EXCEPTION_STACK_SIZE];
+} ExceptionStack;
+
 void exception_init();
 
 // increments stack top and returns pointer to the new top for caller to initialise
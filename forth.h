@@ -10,6 +10,14 @@
 #include "stack.h"
 #include "builtin.h"
 #include "memory.h"
+#include "dict.h"
+#include "input.h"
+#include "output.h"
+#include "image.h"
+#include "compile.h"
+#include "jit.h"
+#include "profile.h"
+#include "task.h"
 
 
 
@@ -23,11 +31,22 @@
 #define INIT_UINCR      (1024)
 #define INIT_UTHRES     (1024)
 
+/* Initial return stack size, in cells: about how deeply colon definitions can nest */
+#define INIT_RSIZE      (1024)
+
+/* Most user memory there can ever be, in cells: 1GB on 64 bit systems, 64MB on 32 bit.  The
+   address space for it is reserved up front, but memory is only committed as it's used */
+#define MAX_USIZE       ((size_t) 1 << (sizeof(void *) >= 8 ? 27 : 24))
+
 typedef struct _dict_header {
     struct _dict_entry *link;
     uint8_t     flags;
     char        name[MAX_WORD_LEN];
     uint32_t    sentinel;
+    uint8_t     flags2;     /* F2_*, in what would otherwise be padding */
+    uint8_t     effect_in;  /* if F2_EFFECT: cells it takes from the data stack */
+    uint8_t     effect_out; /* and leaves there */
+    uint8_t     effect_max; /* most of its own it has there at once, counting what it takes */
     pvf         code;
 } DictHeader;
 
@@ -36,6 +55,10 @@ typedef struct _dict_entry {
     uint8_t     flags;
     char        name[MAX_WORD_LEN];
     uint32_t    sentinel;
+    uint8_t     flags2;
+    uint8_t     effect_in;
+    uint8_t     effect_out;
+    uint8_t     effect_max;
     pvf         code;
     cell        param[];
 } DictEntry;
@@ -82,25 +105,111 @@ enum {
     F_LENMASK = 0x1F,
 };
 
+/* flags2 has room for the flags that don't fit alongside the name length */
+enum {
+    F2_INLINE = 0x01,
+    F2_EFFECT = 0x02,       /* effect_* are known, see compile_effect() */
+};
+
 typedef enum {
     S_INTERPRET = 0,
     S_COMPILE = 1,
 } InterpreterState;
 
+/* Operations interpreted inline by do_colon, see THREADED in builtin.c */
+typedef enum {
+    OP_LIT = 0,
+    OP_BRANCH,
+    OP_0BRANCH,
+    OP_LITSTRING,
+    OP_DROP,
+    OP_SWAP,
+    OP_DUP,
+    OP_OVER,
+    OP_ROT,
+    OP_1PLUS,
+    OP_1MINUS,
+    OP_PLUS,
+    OP_MINUS,
+    OP_MULTIPLY,
+    OP_EQUALS,
+    OP_NOTEQUALS,
+    OP_LT,
+    OP_GT,
+    OP_LTE,
+    OP_GTE,
+    OP_ZERO_EQUALS,
+    OP_NOTZERO_EQUALS,
+    OP_ZERO_LT,
+    OP_ZERO_GT,
+    OP_ZERO_LTE,
+    OP_ZERO_GTE,
+    OP_AND,
+    OP_OR,
+    OP_XOR,
+    OP_INVERT,
+    OP_STORE,
+    OP_FETCH,
+    OP_ADDSTORE,
+    OP_STOREBYTE,
+    OP_FETCHBYTE,
+    OP_LTR,
+    OP_RGT,
+    OP_RAT,
+    OP_DO,
+    OP_QDO,
+    OP_LOOP,
+    OP_PLUSLOOP,
+    OP_I,
+    OP_J,
+    OP_UNLOOP,
+    OP_TAIL,
+
+    // Superinstructions, which the compiler substitutes for pairs of the above
+    OP_LIT_PLUS,
+    OP_DUP_FETCH,
+    OP_OVER_OVER,
+    OP_ZERO_EQUALS_0BRANCH,
+    OP_RAT_ZERO_GT,
+
+    OP_COUNT,
+} ThreadOp;
+
+/* What, if anything, follows an xt inline in a colon definition, see XT-ARG */
 typedef enum {
-    DM_SKIP = -1,
-    DM_NORMAL = 0,
-    DM_BRANCH = 1,
-    DM_LITERAL = 2,
-    DM_SLITERAL = 3,
-} DocolonMode;
-
-extern Stack    data_stack;
-extern Stack    return_stack;
-extern Stack    control_stack;
-
-extern InterpreterState interpreter_state;
-extern DocolonMode docolon_mode;
+    ARG_NONE = 0,
+    ARG_LITERAL,        /* one cell */
+    ARG_BRANCH,         /* one cell: offset relative to itself */
+    ARG_STRING,         /* a length cell, then that many chars padded to a cell boundary */
+    ARG_XT,             /* one cell: the colon definition to jump to */
+} InlineArg;
+
+/*
+  Everything one interpreter owns.  Each thread runs at most one VM at a time, the one vm
+  points to, so any number of them can run side by side without sharing anything but the
+  builtin dictionary entries themselves (which are read only, apart from their flags).
+  See vm_new().
+
+  A VM runs one or more tasks (see task.c), which share everything but their stacks.
+ */
+typedef struct _vm {
+    Task                *task;          /* the one running now: its stacks are the stacks */
+    Task                main_task;      /* the interpreter's own */
+    TaskState           tasks;
+    InterpreterState    interpreter_state;
+    cell                user[USER_COUNT];   /* builtin variables, see var_HERE etc */
+    MemState            mem;
+    DictIndex           dict;
+    InputState          input;
+    OutputState         output;
+    CompileState        compile;
+    JitState            jit;
+    ProfileState        profile;
+    CountedString       word_buf[2];    /* WORD's result, double buffered */
+    int                 word_usebuf;
+} VM;
+
+extern __thread VM *vm;
 
 extern void do_interpret (void*);
 
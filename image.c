@@ -0,0 +1,286 @@
+/*
+
+  Dictionary images.
+
+  An image is a snapshot of the user memory region up to HERE, plus the bits of state that
+  live outside it: the flags of every builtin entry (IMMEDIATE, HIDDEN can be applied to
+  them), and the values of the builtin variables (HERE, LATEST, BASE etc).  Loading one
+  maps the region straight back in from the file, and the interpreter carries on as if it
+  had just compiled everything itself.  The builtin variables saved and restored are the
+  current VM's own copies; the flags are shared by every VM in the process.
+
+  The region is full of absolute addresses: links and xts pointing into the region itself,
+  and xts, code fields and variable addresses pointing into the binary.  Either may be at a
+  different address next time, so when saving, every cell that holds an address in one of
+  those two ranges is marked in a bitmap.  When loading, the marked cells are adjusted by
+  however far their range moved.  If neither moved (the region can usually be placed where
+  it was before, but the binary is subject to ASLR), the mapping isn't touched at all.
+
+  Code fields given native code by the JIT (see jit.c) point at memory that won't be there
+  next time, so those are saved as DOCOL: the threaded body is still intact behind them,
+  and the words are interpreted once loaded.
+
+  This relies on numbers not looking like addresses, which on a 64 bit system they won't
+  unless they were derived from one; and on addresses being stored at cell-aligned
+  locations, which is all the compiler ever does.
+
+  File layout:
+    ImageHeader
+    ImageBuiltin[nbuiltins]     in link order from LATEST's own entry down to __ROOT
+    uint64_t[nwords]            cells holding region addresses
+    uint64_t[nwords]            cells holding binary addresses
+    (padding to a page boundary)
+    the region, up to HERE      (padded to a page boundary)
+
+*/
+
+#define _POSIX_C_SOURCE 200809L  /* pread */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "forth.h"
+#include "vm.h"
+#include "image.h"
+
+#define IMAGE_MAGIC     "FROTHIMG"
+#define IMAGE_VERSION   (1)
+
+enum { RELOC_NONE = 0, RELOC_REGION, RELOC_BINARY };
+
+typedef struct _image_header {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    cell_size;
+    uint64_t    binary_base;    /* where the binary was loaded */
+    uint64_t    binary_size;    /* these two identify the build, for want of anything better */
+    uint64_t    latest_offset;
+    uint64_t    mem_start;
+    uint64_t    mem_ncells;
+    uint64_t    used_cells;
+    uint64_t    nbuiltins;
+    uint64_t    data_offset;    /* page aligned */
+} ImageHeader;
+
+typedef struct _image_builtin {
+    uint8_t     flags;
+    uint8_t     reloc;          /* of value, which is only meaningful for variables */
+    cell        value;
+} ImageBuiltin;
+
+/* These are copied from builtin.h/builtin.c, for easy reference while reading */
+extern DictEntry _dict_var_LATEST;
+extern DictEntry _dict___ROOT;
+
+/* Provided by the linker: the bounds of the loaded binary */
+extern char __executable_start[];
+extern char _end[];
+
+
+static size_t count_builtins () {
+    size_t n = 0;
+    for (DictEntry *de = &_dict_var_LATEST; de != &_dict___ROOT; de = de->link)  n++;
+    return n;
+}
+
+
+static size_t page_align (size_t n) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (n + page - 1) & ~(page - 1);
+}
+
+
+static int classify (cell value, const cell *start, const cell *end) {
+    if (value.as_ptr >= (void *) start && value.as_ptr <= (void *) end)
+        return RELOC_REGION;
+    if (value.as_ptr >= (void *) __executable_start && value.as_ptr < (void *) _end)
+        return RELOC_BINARY;
+    return RELOC_NONE;
+}
+
+
+static cell relocate (cell value, int reloc, intptr_t region_delta, intptr_t binary_delta) {
+    if (reloc == RELOC_REGION)  value.as_i += region_delta;
+    else if (reloc == RELOC_BINARY)  value.as_i += binary_delta;
+    return value;
+}
+
+
+// Returns 0 on success, or -1 (having said why on stderr)
+int image_save (const char *path) {
+    ImageHeader header;
+    ImageBuiltin *builtins = NULL;
+    uint64_t *maps = NULL;
+    cell *cells = NULL;         /* what's written: the region, less any JIT'd code fields */
+    cell *start = mem_get_start();
+    cell *end = start + mem_get_ncells();
+    size_t used, nwords, meta_size, data_size, i;
+    DictEntry *de;
+    FILE *f = NULL;
+    int status = -1;
+
+    if (mem_get_base_ncells() > 0) {
+        fprintf(stderr, "image_save: can't save an image on top of a shared base\n");
+        return -1;
+    }
+
+    used = (CELLALIGN(var_HERE->as_u) - (uintptr_t) start) / sizeof(cell);
+    nwords = (used + 63) / 64;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.cell_size = sizeof(cell);
+    header.binary_base = (uintptr_t) __executable_start;
+    header.binary_size = _end - __executable_start;
+    header.latest_offset = (char *) &_dict_var_LATEST - __executable_start;
+    header.mem_start = (uintptr_t) start;
+    header.mem_ncells = mem_get_ncells();
+    header.used_cells = used;
+    header.nbuiltins = count_builtins();
+
+    meta_size = sizeof(header) + header.nbuiltins * sizeof(*builtins) + 2 * nwords * sizeof(*maps);
+    header.data_offset = page_align(meta_size);
+    data_size = page_align(used * sizeof(cell));
+
+    builtins = calloc(header.nbuiltins, sizeof(*builtins));
+    maps = calloc(2 * nwords, sizeof(*maps));
+    cells = malloc(used * sizeof(*cells));
+    if ((header.nbuiltins && builtins == NULL) || (nwords && maps == NULL)
+        || (used && cells == NULL)) {
+        fprintf(stderr, "image_save: out of memory\n");
+        goto done;
+    }
+
+    for (i = 0, de = &_dict_var_LATEST; de != &_dict___ROOT; de = de->link, i++) {
+        builtins[i].flags = de->flags;
+        if (de->code == do_user) {
+            builtins[i].value = vm->user[de->param[0].as_u];
+            builtins[i].reloc = classify(builtins[i].value, start, end);
+        }
+    }
+
+    for (i = 0; i < used; i++) {
+        cells[i] = start[i];
+        if (jit_contains(cells[i].as_ptr))  cells[i].as_pvf = do_colon;
+
+        switch (classify(cells[i], start, end)) {
+            case RELOC_REGION:  maps[i / 64] |= UINT64_C(1) << (i % 64);  break;
+            case RELOC_BINARY:  maps[nwords + i / 64] |= UINT64_C(1) << (i % 64);  break;
+        }
+    }
+
+    if ((f = fopen(path, "wb")) == NULL
+        || fwrite(&header, sizeof(header), 1, f) != 1
+        || fwrite(builtins, sizeof(*builtins), header.nbuiltins, f) != header.nbuiltins
+        || fwrite(maps, sizeof(*maps), 2 * nwords, f) != 2 * nwords
+        || fseek(f, header.data_offset, SEEK_SET) != 0
+        || fwrite(cells, sizeof(cell), used, f) != used
+        || fflush(f) != 0
+        || ftruncate(fileno(f), header.data_offset + data_size) != 0) {
+        perror(path);
+        goto done;
+    }
+
+    status = 0;
+
+done:
+    if (f && fclose(f) != 0 && status == 0) {
+        perror(path);
+        status = -1;
+    }
+    free(builtins);
+    free(maps);
+    free(cells);
+    return status;
+}
+
+
+// Returns 0 on success, or -1 (having said why on stderr).  On failure nothing has changed
+int image_load (const char *path) {
+    ImageHeader header;
+    ImageBuiltin *builtins = NULL;
+    uint64_t *maps = NULL;
+    cell *start;
+    size_t nwords, builtins_size, maps_size, i;
+    intptr_t region_delta, binary_delta;
+    DictEntry *de;
+    int fd, status = -1;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        perror(path);
+        return -1;
+    }
+
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+        || memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != IMAGE_VERSION) {
+        fprintf(stderr, "%s: not an image file\n", path);
+        goto done;
+    }
+
+    if (header.cell_size != sizeof(cell)
+        || header.binary_size != (uint64_t)(_end - __executable_start)
+        || header.latest_offset != (uint64_t)((char *) &_dict_var_LATEST - __executable_start)
+        || header.nbuiltins != count_builtins()
+        || header.used_cells > header.mem_ncells) {
+        fprintf(stderr, "%s: image was saved by a different build\n", path);
+        goto done;
+    }
+
+    nwords = (header.used_cells + 63) / 64;
+    builtins_size = header.nbuiltins * sizeof(*builtins);
+    maps_size = 2 * nwords * sizeof(*maps);
+    builtins = malloc(builtins_size);
+    maps = malloc(maps_size);
+    if ((header.nbuiltins && builtins == NULL) || (nwords && maps == NULL)) {
+        fprintf(stderr, "image_load: out of memory\n");
+        goto done;
+    }
+
+    if (pread(fd, builtins, builtins_size, sizeof(header)) != (ssize_t) builtins_size
+        || pread(fd, maps, maps_size, sizeof(header) + builtins_size) != (ssize_t) maps_size) {
+        fprintf(stderr, "%s: truncated image\n", path);
+        goto done;
+    }
+
+    // From here on, the old region is gone
+    start = mem_load(fd, header.data_offset, header.used_cells * sizeof(cell),
+                     header.mem_ncells, (void *)(uintptr_t) header.mem_start);
+    if (start == NULL) {
+        perror(path);
+        goto done;
+    }
+
+    region_delta = (uintptr_t) start - header.mem_start;
+    binary_delta = (uintptr_t) __executable_start - header.binary_base;
+
+    if (region_delta != 0 || binary_delta != 0) {
+        for (i = 0; i < header.used_cells; i++) {
+            if (maps[i / 64] & (UINT64_C(1) << (i % 64)))
+                start[i].as_i += region_delta;
+            else if (maps[nwords + i / 64] & (UINT64_C(1) << (i % 64)))
+                start[i].as_i += binary_delta;
+        }
+    }
+
+    for (i = 0, de = &_dict_var_LATEST; de != &_dict___ROOT; de = de->link, i++) {
+        de->flags = builtins[i].flags;
+        if (de->code == do_user) {
+            vm->user[de->param[0].as_u] = relocate(builtins[i].value, builtins[i].reloc, region_delta, binary_delta);
+        }
+    }
+
+    dict_init();
+    status = 0;
+
+done:
+    close(fd);  // the mapping doesn't need it
+    free(builtins);
+    free(maps);
+    return status;
+}
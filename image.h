@@ -0,0 +1,9 @@
+#ifndef _IMAGE_H
+#define _IMAGE_H
+
+
+int  image_save (const char *path);
+int  image_load (const char *path);
+
+
+#endif /* _IMAGE_H */
@@ -0,0 +1,277 @@
+/*
+
+  Input sources.
+
+  The interpreter parses from a line buffer rather than pulling characters from stdio one at
+  a time.  SOURCE is the current line and >IN is the offset of the next character in it.
+  WORD scans the buffer in place, KEY takes single characters from it, and either one will
+  REFILL it with the next line when it runs out.
+
+  stdin is always at the bottom of a stack of sources.  INCLUDED and INCLUDE-FILE push a
+  source on top of it that maps the whole file into memory, and whose "lines" are just
+  windows onto the mapping, so nothing is copied on the way in.  When an included source
+  runs out it stays on the stack, marked eof, until whoever pushed it pops it off.
+
+*/
+
+#define _POSIX_C_SOURCE 200809L  /* getline */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "forth.h"
+#include "input.h"
+
+/* Private state, one per VM (see InputState in input.h) */
+#define sources     (vm->input.sources)
+#define current     (vm->input.current)
+
+
+static int file_refill (InputSource *source) {
+    ssize_t len;
+
+    // As stdio would, show what's been written so far before waiting on the terminal
+    if (vm->output.tty)  output_flush();
+
+    len = getline(&source->linebuf, &source->linecap, source->file);
+
+    if (len < 0) {
+        source->buffer = NULL;
+        source->length = 0;
+        source->in.as_u = 0;
+        return 0;
+    }
+
+    source->buffer = source->linebuf;
+    source->length = len;
+    source->in.as_u = 0;
+    return 1;
+}
+
+
+static int map_refill (InputSource *source) {
+    const char *line = source->map + source->mappos;
+    size_t left = source->maplen - source->mappos;
+    const char *nl;
+
+    if (left == 0)  return 0;
+
+    nl = memchr(line, '\n', left);
+    source->buffer = line;
+    source->length = nl ? (size_t)(nl - line) + 1 : left;
+    source->in.as_u = 0;
+    source->mappos += source->length;
+    return 1;
+}
+
+
+void input_init () {
+    input_restore(0);
+
+    free(sources[0].linebuf);
+    memset(&sources[0], 0, sizeof(sources[0]));
+
+    sources[0].refill = file_refill;
+    sources[0].file = stdin;
+
+    current = &sources[0];
+}
+
+
+// Pops any included sources, and frees stdin's line buffer
+void input_destroy () {
+    input_restore(0);
+
+    free(sources[0].linebuf);
+    memset(&sources[0], 0, sizeof(sources[0]));
+    current = NULL;
+}
+
+
+InputSource *input_current () {
+    return current;
+}
+
+
+// Number of sources stacked on top of stdin
+size_t input_depth () {
+    return current ? current - sources : 0;
+}
+
+
+// Pushes a source that reads all of fd (which the caller still owns).  Returns 0 on
+// success, or -1 with errno set
+int input_include_fd (int fd) {
+    struct stat st;
+    void *map = NULL;
+
+    if (input_depth() >= MAX_INPUT_DEPTH - 1) {
+        errno = EMFILE;
+        return -1;
+    }
+
+    if (fstat(fd, &st) != 0)  return -1;
+
+    if (st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)  return -1;
+        posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+    }
+
+    ++current;
+    memset(current, 0, sizeof(*current));
+    current->refill = map_refill;
+    current->map = map;
+    current->maplen = st.st_size;
+    return 0;
+}
+
+
+// Pushes a source that reads all of the file at path.  Returns 0 on success, or -1 with
+// errno set
+int input_include_file (const char *path) {
+    int fd, status, saved_errno;
+
+    if ((fd = open(path, O_RDONLY)) < 0)  return -1;
+
+    status = input_include_fd(fd);
+    saved_errno = errno;
+    close(fd);  // the mapping, if there is one, doesn't need it
+    errno = saved_errno;
+
+    return status;
+}
+
+
+// Pops an included source, returning to wherever its includer had got up to
+void input_pop () {
+    if (current == &sources[0])  return;
+
+    if (current->map)  munmap((void *) current->map, current->maplen);
+    --current;
+}
+
+
+// Pops sources until there are only depth of them left on top of stdin
+void input_restore (size_t depth) {
+    while (input_depth() > depth)  input_pop();
+}
+
+
+// Reads the next line of input into the buffer.  Returns 0 at end of input
+int input_refill () {
+    if (current->eof)  return 0;
+    if (!current->refill(current))  current->eof = 1;
+    return !current->eof;
+}
+
+
+// Returns the next character of input, or EOF
+int input_key () {
+    while (current->in.as_u >= current->length) {
+        if (!input_refill())  return EOF;
+    }
+
+    return (unsigned char) current->buffer[current->in.as_u++];
+}
+
+
+/*
+  Parses a word from the input, skipping leading delimiters, into dest (not counted,
+  but NUL-terminated).  When delim is a space, any control character also counts as a
+  delimiter.  The delimiter that ends the word is consumed.
+
+  Returns the length of the word (running out of input also ends it); -1 if input ran out
+  before a word even started; or a value greater than max if the word was too long, in
+  which case dest holds the first max characters.  dest must have room for max + 1.
+*/
+intptr_t input_word (int delim, char *dest, size_t max) {
+    const int blank = (delim == ' ');
+    register const unsigned char *p, *end;
+    size_t len = 0;
+
+    // Skip leading delimiters, across lines if need be
+    for (;;) {
+        if (current->in.as_u >= current->length) {
+            if (!input_refill())  return -1;
+            continue;
+        }
+
+        p = (const unsigned char *) current->buffer + current->in.as_u;
+        end = (const unsigned char *) current->buffer + current->length;
+        if (blank)  while (p < end && *p <= ' ')  p++;
+        else        while (p < end && *p == delim)  p++;
+        current->in.as_u = p - (const unsigned char *) current->buffer;
+
+        if (p < end)  break;
+    }
+
+    // Copy characters up to the next delimiter, continuing onto the next line if it's not there
+    for (;;) {
+        const unsigned char *stop;
+
+        p = (const unsigned char *) current->buffer + current->in.as_u;
+        end = (const unsigned char *) current->buffer + current->length;
+        if (blank) {
+            for (stop = p; stop < end && *stop > ' '; stop++) ;
+        }
+        else {
+            stop = memchr(p, delim, end - p);
+            if (stop == NULL)  stop = end;
+        }
+
+        if (len < max)  memcpy(dest + len, p, (size_t)(stop - p) < max - len ? stop - p : max - len);
+        len += stop - p;
+
+        if (stop < end) {
+            // found the delimiter, step over it
+            current->in.as_u = stop + 1 - (const unsigned char *) current->buffer;
+            break;
+        }
+
+        current->in.as_u = current->length;
+        if (!input_refill())  break;
+    }
+
+    dest[len < max ? len : max] = '\0';
+    return len;
+}
+
+
+/*
+  Finds the next space-delimited name in the current source, without copying it.  Sets
+  *name to the start of it, and returns its length; or -1 at the end of the source.
+  Unlike WORD, a name never continues onto the next line.
+*/
+intptr_t input_parse_name (const char **name) {
+    register const unsigned char *p, *end, *start;
+
+    for (;;) {
+        p = (const unsigned char *) current->buffer + current->in.as_u;
+        end = (const unsigned char *) current->buffer + current->length;
+        while (p < end && *p <= ' ')  p++;
+        if (p < end)  break;
+
+        current->in.as_u = current->length;
+        if (!input_refill())  return -1;
+    }
+
+    start = p;
+    while (p < end && *p > ' ')  p++;
+
+    *name = (const char *) start;
+    current->in.as_u = (p < end ? p + 1 : p) - (const unsigned char *) current->buffer;
+    return p - start;
+}
+
+
+// Discards whatever is left of the current line
+void input_dropline () {
+    current->in.as_u = current->length;
+}
@@ -0,0 +1,46 @@
+#ifndef _INPUT_H
+#define _INPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cell.h"
+
+typedef struct _input_source {
+    const char  *buffer;    /* current line, including its '\n' if it had one */
+    size_t      length;
+    cell        in;         /* >IN: offset into buffer of the next character to parse */
+    int         (*refill)(struct _input_source *);  /* returns 0 at end of input */
+    int         eof;        /* refill has failed, there's nothing left */
+    FILE        *file;
+    char        *linebuf;   /* buffer owned by getline, for file sources */
+    size_t      linecap;
+    const char  *map;       /* whole file, for mapped sources */
+    size_t      maplen;
+    size_t      mappos;     /* offset of the line after this one */
+} InputSource;
+
+#define MAX_INPUT_DEPTH     (16)
+
+typedef struct _input_state {
+    InputSource sources[MAX_INPUT_DEPTH];   /* [0] is stdin */
+    InputSource *current;
+} InputState;
+
+void input_init ();
+void input_destroy ();
+InputSource *input_current ();
+size_t input_depth ();
+int  input_include_fd (int fd);
+int  input_include_file (const char *path);
+void input_pop ();
+void input_restore (size_t depth);
+int  input_refill ();
+int  input_key ();
+intptr_t input_word (int delim, char *dest, size_t max);
+intptr_t input_parse_name (const char **name);
+void input_dropline ();
+
+
+#endif /* _INPUT_H */
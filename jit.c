@@ -0,0 +1,829 @@
+/*
+
+  Native code for colon definitions, on x86-64.
+
+  With JIT set, `;` translates the definition it ends into machine code, and points its code
+  field at that instead of do_colon.  Nothing else about the word changes.  Its xt is the
+  same, and EXECUTE, CATCH and the interpreter call the code field just as they would a
+  primitive's.  The body is still there for SEE and for inlining, and images save the word
+  with do_colon in its code field, since the native code isn't saved with it.  JIT is 0
+  to begin with, and only affects words defined while it's set, so the same source can be
+  loaded both ways and the two compared.
+
+  The code keeps what do_colon keeps in registers in callee-saved ones, so they survive
+  calls out to C:
+      rbx  &data_stack                r12  data_stack.values
+      r13  top of stack (tos)         r14  data_stack.top
+      r15  &return_stack              rbp  data_stack.size - 1, for overflow checks
+  Like do_colon, it spills tos and top back to the data stack before calling anything that
+  isn't native, and before throwing.  The return stack isn't cached at all: >R, DO and the
+  rest work on return_stack.top in memory, so C words like 2>R see it as it is.
+
+  Each word has two entry points.  Its code field points at one that can be called from C.
+  That saves the callee-saved registers, loads the stacks (jit_stacks() finds them, vm being
+  thread local), and calls the other entry, which expects all that done.  One native word
+  calls another by calling its inner entry directly, and a call just before EXIT (or a
+  (TAIL)) jumps there instead, so native code never goes back through the interpreter.
+  The return addresses go on the C stack, but each of those calls still takes a cell of the
+  return stack (return_stack.top goes up around it), so nesting is limited by RSIZE as it
+  is in do_colon, and runaway recursion throws rather than running off the end of the C
+  stack.  A very large RSIZE can still do that, in a TASK.
+
+  Threaded operations are all generated inline, with the same stack checks as do_colon
+  makes, and they throw the same exceptions.  If the word's stack effect is known (see
+  compile.c), the data stack is checked just once instead, at the top of the body, for
+  everything it takes and the most it will have there.  Return stack checks stay.
+  Anything else is called through its code field: primitives, variables, and colon
+  definitions that aren't native, which do_colon then runs, nesting on the return stack as
+  usual.
+
+  The code goes into chunks of one range of addresses reserved for the whole process, so
+  jit_contains() is just a range check.  The chunks are mapped read/write/execute.  Each
+  belongs to the VM that made it, and is given back when that VM is freed.  Definitions a
+  MARKER forgets leave their code behind until then.
+
+  Anywhere but x86-64, or if the memory can't be made executable, JIT does nothing.
+
+*/
+
+#define _GNU_SOURCE  /* MAP_ANONYMOUS, MAP_NORESERVE */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "forth.h"
+#include "vm.h"
+#include "jit.h"
+
+#define JIT_ARENA_SIZE  ((size_t) 256 << 20)    /* address space, not memory */
+#define JIT_CHUNK_SIZE  ((size_t) 64 << 10)
+
+/* Private state, one per VM (see JitState in jit.h) */
+#define chunk       (vm->jit.chunk)
+#define chunk_used  (vm->jit.used)
+#define chunk_size  (vm->jit.size)
+
+/* Shared by every VM */
+static char *arena = NULL;
+static size_t arena_used = 0;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+
+static void arena_init () {
+    void *p = mmap(NULL, JIT_ARENA_SIZE, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p != MAP_FAILED)  arena = p;
+}
+
+
+// Does p point into native code?
+int jit_contains (const void *p) {
+    return arena != NULL && (const char *) p >= arena && (const char *) p < arena + JIT_ARENA_SIZE;
+}
+
+
+// Gives this VM's chunks back.  The addresses aren't used again, but the memory is freed
+void jit_destroy () {
+    while (chunk) {
+        char *prev = *(char **) chunk;
+        mmap(chunk, chunk_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+        chunk = prev;
+        chunk_size = prev ? ((size_t *) prev)[1] : 0;
+    }
+    chunk_used = chunk_size = 0;
+}
+
+
+// Finds room for n bytes of code, 16 byte aligned.  NULL if there isn't any
+static char *jit_alloc (size_t n) {
+    size_t header = 2 * sizeof(size_t);     // link to the previous chunk, and this one's size
+
+    chunk_used = (chunk_used + 15) & ~(size_t) 15;
+    if (chunk == NULL || chunk_used + n > chunk_size) {
+        size_t new_size = JIT_CHUNK_SIZE, start;
+        char *new_chunk;
+
+        pthread_once(&arena_once, arena_init);
+        if (arena == NULL)  return NULL;
+
+        while (new_size < n + 16 + header)  new_size *= 2;
+        start = __sync_fetch_and_add(&arena_used, new_size);
+        if (start + new_size > JIT_ARENA_SIZE)  return NULL;
+
+        new_chunk = arena + start;
+        if (mprotect(new_chunk, new_size, PROT_READ | PROT_WRITE | PROT_EXEC) != 0)  return NULL;
+
+        *(char **) new_chunk = chunk;
+        ((size_t *) new_chunk)[1] = new_size;
+        chunk = new_chunk;
+        chunk_size = new_size;
+        chunk_used = header;
+    }
+
+    chunk_used += n;
+    return chunk + chunk_used - n;
+}
+
+
+#ifdef __x86_64__
+
+/* Labels, besides the one for each cell of the body */
+enum { L_INNER = 0, L_BODY, L_EXIT, L_DS_UNDER, L_DS_OVER, L_RS_UNDER, L_RS_OVER, L_COUNT };
+
+typedef struct _code {
+    uint8_t     *bytes;
+    size_t      length;
+    size_t      capacity;
+    long        *labels;        /* code offset of each cell of the body, then L_* */
+    size_t      nlabels;
+    struct _jump {
+        size_t  at;             /* the rel32 to fill in */
+        size_t  label;
+    }           *jumps;
+    size_t      njumps;
+    size_t      jumps_capacity;
+    int         failed;         /* out of memory, or something it can't translate */
+    int         checked;        /* the data stack was checked on the way in */
+} Code;
+
+#define OFF_TOP     ((uint8_t) offsetof(Stack, top))
+#define OFF_SIZE    ((uint8_t) offsetof(Stack, size))
+#define OFF_VALUES  ((uint8_t) offsetof(Stack, values))
+#define RS_DELTA    ((int32_t)(offsetof(Task, return_stack) - offsetof(Task, data_stack)))
+
+/* Conditions, as in jcc (0x0F 0x80+cc) and setcc (0x0F 0x90+cc) */
+enum { CC_E = 0x4, CC_NE = 0x5, CC_NS = 0x9,
+       CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+#define EMIT(...)   do { const uint8_t b_[] = { __VA_ARGS__ }; emit(c, b_, sizeof(b_)); } while (0)
+
+
+static Stack *jit_stacks () {
+    return &vm->task->data_stack;
+}
+
+
+static void emit (Code *c, const uint8_t *bytes, size_t n) {
+    if (c->length + n > c->capacity) {
+        size_t new_capacity = c->capacity ? 2 * c->capacity : 4096;
+        uint8_t *new_bytes;
+
+        while (new_capacity < c->length + n)  new_capacity *= 2;
+        if ((new_bytes = realloc(c->bytes, new_capacity)) == NULL) {
+            c->failed = 1;
+            return;
+        }
+        c->bytes = new_bytes;
+        c->capacity = new_capacity;
+    }
+    memcpy(c->bytes + c->length, bytes, n);
+    c->length += n;
+}
+
+
+static void emit8 (Code *c, uint8_t b)      { emit(c, &b, 1); }
+static void emit32 (Code *c, int32_t v)     { emit(c, (uint8_t *) &v, 4); }
+static void emit64 (Code *c, uint64_t v)    { emit(c, (uint8_t *) &v, 8); }
+
+
+static void label (Code *c, size_t l) {
+    c->labels[l] = c->length;
+}
+
+
+// A rel32 to label l, filled in once everything's been generated
+static void rel32 (Code *c, size_t l) {
+    if (c->njumps == c->jumps_capacity) {
+        size_t new_capacity = c->jumps_capacity ? 2 * c->jumps_capacity : 64;
+        struct _jump *new_jumps = realloc(c->jumps, new_capacity * sizeof(*new_jumps));
+
+        if (new_jumps == NULL) {
+            c->failed = 1;
+            return;
+        }
+        c->jumps = new_jumps;
+        c->jumps_capacity = new_capacity;
+    }
+    c->jumps[c->njumps++] = (struct _jump) { c->length, l };
+    emit32(c, 0);
+}
+
+
+static void jmp (Code *c, size_t l)         { emit8(c, 0xE9); rel32(c, l); }
+static void jcc (Code *c, int cc, size_t l) { emit8(c, 0x0F); emit8(c, 0x80 + cc); rel32(c, l); }
+static void call_label (Code *c, size_t l)  { emit8(c, 0xE8); rel32(c, l); }
+
+// mov rax, imm64; call rax (or jmp rax)
+static void call_abs (Code *c, const void *f)   { EMIT(0x48, 0xB8); emit64(c, (uintptr_t) f); EMIT(0xFF, 0xD0); }
+static void jmp_abs (Code *c, const void *f)    { EMIT(0x48, 0xB8); emit64(c, (uintptr_t) f); EMIT(0xFF, 0xE0); }
+
+
+/* The data stack */
+
+// values[top] = tos; data_stack.top = top
+static void spill (Code *c) {
+    EMIT(0x4F, 0x89, 0x2C, 0xF4);               // mov [r12+r14*8], r13
+    EMIT(0x44, 0x89, 0x73, OFF_TOP);            // mov [rbx+top], r14d
+}
+
+// top = data_stack.top; tos = values[top]
+static void fill (Code *c) {
+    EMIT(0x4C, 0x63, 0x73, OFF_TOP);            // movsxd r14, [rbx+top]
+    EMIT(0x4C, 0x8B, 0x63, OFF_VALUES);         // mov r12, [rbx+values]
+    EMIT(0x4F, 0x8B, 0x2C, 0xF4);               // mov r13, [r12+r14*8]
+}
+
+// Throws unless there are at least n on the stack
+static void need (Code *c, int n) {
+    if (c->checked)  return;
+    if (n <= 128) {
+        EMIT(0x49, 0x83, 0xFE, (uint8_t)(n - 1));   // cmp r14, n-1
+    }
+    else {
+        EMIT(0x49, 0x81, 0xFE);                     // cmp r14, imm32
+        emit32(c, n - 1);
+    }
+    jcc(c, CC_L, L_DS_UNDER);
+}
+
+// Throws unless there's room for n more
+static void room (Code *c, int n) {
+    if (c->checked)  return;
+    if (n < 128) {
+        EMIT(0x49, 0x8D, 0x46, (uint8_t) n);    // lea rax, [r14+n]
+    }
+    else {
+        EMIT(0x49, 0x8D, 0x86);                 // lea rax, [r14+disp32]
+        emit32(c, n);
+    }
+    EMIT(0x48, 0x39, 0xE8);                     // cmp rax, rbp
+    jcc(c, CC_G, L_DS_OVER);
+}
+
+// Makes room for a new tos, which is left as it was (the DUP)
+static void push (Code *c) {
+    EMIT(0x4F, 0x89, 0x2C, 0xF4);               // mov [r12+r14*8], r13
+    EMIT(0x49, 0xFF, 0xC6);                     // inc r14
+}
+
+// Pushes rax, rcx, rdx or rbx (reg 0-3)
+static void push_reg (Code *c, int reg) {
+    push(c);
+    EMIT(0x49, 0x89);                           // mov r13, reg
+    emit8(c, 0xC5 | (reg << 3));
+}
+
+static void push_imm (Code *c, intptr_t v) {
+    push(c);
+    EMIT(0x49, 0xBD);                           // mov r13, imm64
+    emit64(c, v);
+}
+
+static void drop (Code *c, int n) {
+    if (n == 1)  EMIT(0x49, 0xFF, 0xCE);        // dec r14
+    else  EMIT(0x49, 0x83, 0xEE, (uint8_t) n); // sub r14, n
+    EMIT(0x4F, 0x8B, 0x2C, 0xF4);               // mov r13, [r12+r14*8]
+}
+
+// opcode reg, [r12+r14*8-8n], with reg 0-7, or 13 for tos
+static void ds_op (Code *c, uint8_t opcode, int reg, int n) {
+    emit8(c, reg >= 8 ? 0x4F : 0x4B);
+    emit8(c, opcode);
+    emit8(c, 0x44 | ((reg & 7) << 3));
+    emit8(c, 0xF4);
+    emit8(c, (uint8_t)(-8 * n));
+}
+
+#define TOS     (13)
+#define ds_load(C, REG, N)      ds_op((C), 0x8B, (REG), (N))
+#define ds_store(C, REG, N)     ds_op((C), 0x89, (REG), (N))
+
+// tos = (tos cc 0) or (DS(1) cc tos), as 0 or 1
+static void compare (Code *c, int cc, int binary) {
+    if (binary) {
+        need(c, 2);
+        ds_load(c, 0, 1);                       // mov rax, DS(1)
+        EMIT(0x49, 0xFF, 0xCE);                 // dec r14
+        EMIT(0x4C, 0x39, 0xE8);                 // cmp rax, r13
+    }
+    else {
+        need(c, 1);
+        EMIT(0x4D, 0x85, 0xED);                 // test r13, r13
+    }
+    EMIT(0x0F, 0x90 + cc, 0xC0);                // setcc al
+    EMIT(0x4C, 0x0F, 0xB6, 0xE8);               // movzx r13, al
+}
+
+// tos = DS(1) op tos, for add, and, or, xor
+static void binary (Code *c, uint8_t opcode) {
+    need(c, 2);
+    ds_op(c, opcode, TOS, 1);                   // op r13, DS(1)
+    EMIT(0x49, 0xFF, 0xCE);                     // dec r14
+}
+
+
+/* The return stack, which is always in memory: eax = top, rcx = values */
+
+static void rs_load (Code *c) {
+    EMIT(0x49, 0x63, 0x47, OFF_TOP);            // movsxd rax, [r15+top]
+    EMIT(0x49, 0x8B, 0x4F, OFF_VALUES);         // mov rcx, [r15+values]
+}
+
+static void rs_store_top (Code *c, int reg) {   // eax or edx
+    EMIT(0x41, 0x89);                           // mov [r15+top], reg
+    emit8(c, 0x47 | (reg << 3));
+    emit8(c, OFF_TOP);
+}
+
+// Throws unless there are at least n on the return stack
+static void rs_need (Code *c, int n) {
+    EMIT(0x83, 0xF8, (uint8_t)(n - 1));         // cmp eax, n-1
+    jcc(c, CC_L, L_RS_UNDER);
+}
+
+// Throws unless there's room for n more; edx = top + n
+static void rs_room (Code *c, int n) {
+    EMIT(0x8D, 0x50, (uint8_t) n);              // lea edx, [rax+n]
+    EMIT(0x41, 0x3B, 0x57, OFF_SIZE);           // cmp edx, [r15+size]
+    jcc(c, CC_GE, L_RS_OVER);
+}
+
+
+/* Calls */
+
+static const void *inner_entry (const pvf *xt) {
+    return *(const void **)((const char *) *xt - 16);
+}
+
+// Takes a cell of the return stack for the duration of a native call, as do_colon would.
+// There's no return address to put in it, so it's zeroed, for the sampler to pass over
+// rather than take whatever an earlier call left there for one
+static void nest (Code *c) {
+    EMIT(0x41, 0x8B, 0x47, OFF_TOP);            // mov eax, [r15+top]
+    EMIT(0xFF, 0xC0);                           // inc eax
+    EMIT(0x41, 0x3B, 0x47, OFF_SIZE);           // cmp eax, [r15+size]
+    jcc(c, CC_GE, L_RS_OVER);
+    EMIT(0x49, 0x8B, 0x4F, OFF_VALUES);         // mov rcx, [r15+values]
+    EMIT(0x48, 0xC7, 0x04, 0xC1, 0, 0, 0, 0);   // mov qword [rcx+rax*8], 0
+    rs_store_top(c, 0);
+}
+
+static void unnest (Code *c) {
+    EMIT(0x41, 0xFF, 0x4F, OFF_TOP);            // dec dword [r15+top]
+}
+
+// Calls xt through its code field, or a native word's inner entry directly
+static void call_xt (Code *c, const pvf *xt, const pvf *self) {
+    if (xt == self) {
+        nest(c);
+        call_label(c, L_INNER);
+        unnest(c);
+    }
+    else if (jit_contains(*xt)) {
+        nest(c);
+        call_abs(c, inner_entry(xt));
+        unnest(c);
+    }
+    else {
+        spill(c);
+        EMIT(0x48, 0xBF);                       // mov rdi, imm64
+        emit64(c, (uintptr_t) CFA_to_DFA(xt));
+        call_abs(c, (const void *) *xt);
+        fill(c);
+    }
+}
+
+// Calls xt and returns, jumping to it if it's native
+static void tail_xt (Code *c, const pvf *xt, const pvf *self) {
+    if (xt == self) {
+        jmp(c, L_BODY);
+    }
+    else if (jit_contains(*xt)) {
+        EMIT(0x48, 0x83, 0xC4, 0x08);           // add rsp, 8
+        jmp_abs(c, inner_entry(xt));
+    }
+    else {
+        call_xt(c, xt, self);
+        jmp(c, L_EXIT);
+    }
+}
+
+
+static cell *next_instruction (cell *p) {
+    const pvf *xt = p->as_xt;
+
+    if (xt == NULL)  return p + 1;  /* EXIT */
+    if (!dict_contains(CFA_to_DE(xt)))  return NULL;
+
+    switch (vm_xt_arg(xt)) {
+        case ARG_NONE:      return p + 1;
+        case ARG_STRING:    return p + 2 + CELLALIGN(p[1].as_u) / sizeof(cell);
+        default:            return p + 2;
+    }
+}
+
+
+// Generates the code for the instruction at p, which is followed by next
+static void generate (Code *c, cell *start, cell *p, cell *next, const pvf *self) {
+    const pvf *xt = p->as_xt;
+    size_t target = 0;
+
+    if (xt == NULL) {
+        jmp(c, L_EXIT);
+        return;
+    }
+
+    if (*xt != do_threaded) {
+        if (next->as_xt == NULL)  tail_xt(c, xt, self);
+        else  call_xt(c, xt, self);
+        return;
+    }
+
+    if (vm_xt_arg(xt) == ARG_BRANCH) {
+        cell *to = p + 1 + p[1].as_i;
+        if (to < start || to - start >= (ptrdiff_t)(c->nlabels - L_COUNT)) {
+            c->failed = 1;
+            return;
+        }
+        target = L_COUNT + (to - start);
+    }
+
+    switch ((ThreadOp) (CFA_to_DFA(xt))->as_i) {
+        case OP_LIT:
+            room(c, 1);
+            push_imm(c, p[1].as_i);
+            break;
+
+        case OP_BRANCH:
+            jmp(c, target);
+            break;
+
+        case OP_0BRANCH:
+        case OP_ZERO_EQUALS_0BRANCH:
+            need(c, 1);
+            EMIT(0x4C, 0x89, 0xE8);             // mov rax, r13
+            drop(c, 1);
+            EMIT(0x48, 0x85, 0xC0);             // test rax, rax
+            jcc(c, (CFA_to_DFA(xt))->as_i == OP_0BRANCH ? CC_E : CC_NE, target);
+            break;
+
+        case OP_LITSTRING:
+            room(c, 2);
+            push_imm(c, (intptr_t) &p[2]);
+            push_imm(c, p[1].as_i);
+            break;
+
+        case OP_DROP:
+            need(c, 1);
+            drop(c, 1);
+            break;
+
+        case OP_SWAP:
+            need(c, 2);
+            ds_load(c, 0, 1);                   // mov rax, DS(1)
+            ds_store(c, TOS, 1);                // mov DS(1), r13
+            EMIT(0x49, 0x89, 0xC5);             // mov r13, rax
+            break;
+
+        case OP_DUP:
+            need(c, 1);
+            room(c, 1);
+            push(c);
+            break;
+
+        case OP_OVER:
+            need(c, 2);
+            room(c, 1);
+            ds_load(c, 0, 1);
+            push_reg(c, 0);
+            break;
+
+        case OP_ROT:
+            need(c, 3);
+            ds_load(c, 0, 1);                   // mov rax, DS(1)
+            ds_load(c, 1, 2);                   // mov rcx, DS(2)
+            ds_store(c, 1, 1);                  // mov DS(1), rcx
+            ds_store(c, TOS, 2);                // mov DS(2), r13
+            EMIT(0x49, 0x89, 0xC5);             // mov r13, rax
+            break;
+
+        case OP_1PLUS:      need(c, 1);  EMIT(0x49, 0xFF, 0xC5);  break;   // inc r13
+        case OP_1MINUS:     need(c, 1);  EMIT(0x49, 0xFF, 0xCD);  break;   // dec r13
+        case OP_PLUS:       binary(c, 0x03);  break;
+        case OP_AND:        binary(c, 0x23);  break;
+        case OP_OR:         binary(c, 0x0B);  break;
+        case OP_XOR:        binary(c, 0x33);  break;
+        case OP_INVERT:     need(c, 1);  EMIT(0x49, 0xF7, 0xD5);  break;   // not r13
+
+        case OP_MINUS:
+            need(c, 2);
+            ds_load(c, 0, 1);                   // mov rax, DS(1)
+            EMIT(0x4C, 0x29, 0xE8);             // sub rax, r13
+            EMIT(0x49, 0x89, 0xC5);             // mov r13, rax
+            EMIT(0x49, 0xFF, 0xCE);             // dec r14
+            break;
+
+        case OP_MULTIPLY:
+            need(c, 2);
+            EMIT(0x4F, 0x0F, 0xAF, 0x6C, 0xF4, 0xF8);   // imul r13, DS(1)
+            EMIT(0x49, 0xFF, 0xCE);             // dec r14
+            break;
+
+        case OP_EQUALS:             compare(c, CC_E, 1);   break;
+        case OP_NOTEQUALS:          compare(c, CC_NE, 1);  break;
+        case OP_LT:                 compare(c, CC_L, 1);   break;
+        case OP_GT:                 compare(c, CC_G, 1);   break;
+        case OP_LTE:                compare(c, CC_LE, 1);  break;
+        case OP_GTE:                compare(c, CC_GE, 1);  break;
+        case OP_ZERO_EQUALS:        compare(c, CC_E, 0);   break;
+        case OP_NOTZERO_EQUALS:     compare(c, CC_NE, 0);  break;
+        case OP_ZERO_LT:            compare(c, CC_L, 0);   break;
+        case OP_ZERO_GT:            compare(c, CC_G, 0);   break;
+        case OP_ZERO_LTE:           compare(c, CC_LE, 0);  break;
+        case OP_ZERO_GTE:           compare(c, CC_GE, 0);  break;
+
+        case OP_STORE:
+            need(c, 2);
+            ds_load(c, 0, 1);
+            EMIT(0x49, 0x89, 0x45, 0x00);       // mov [r13], rax
+            drop(c, 2);
+            break;
+
+        case OP_FETCH:
+            need(c, 1);
+            EMIT(0x4D, 0x8B, 0x6D, 0x00);       // mov r13, [r13]
+            break;
+
+        case OP_ADDSTORE:
+            need(c, 2);
+            ds_load(c, 0, 1);
+            EMIT(0x49, 0x01, 0x45, 0x00);       // add [r13], rax
+            drop(c, 2);
+            break;
+
+        case OP_STOREBYTE:
+            need(c, 2);
+            ds_load(c, 0, 1);
+            EMIT(0x41, 0x88, 0x45, 0x00);       // mov [r13], al
+            drop(c, 2);
+            break;
+
+        case OP_FETCHBYTE:
+            need(c, 1);
+            EMIT(0x4D, 0x0F, 0xB6, 0x6D, 0x00); // movzx r13, byte [r13]
+            break;
+
+        case OP_LTR:
+            need(c, 1);
+            rs_load(c);
+            rs_room(c, 1);
+            EMIT(0x4C, 0x89, 0x6C, 0xC1, 0x08); // mov [rcx+rax*8+8], r13
+            rs_store_top(c, 2);
+            drop(c, 1);
+            break;
+
+        case OP_RGT:
+        case OP_RAT:
+        case OP_RAT_ZERO_GT:
+            room(c, 1);
+            rs_load(c);
+            rs_need(c, 1);
+            EMIT(0x48, 0x8B, 0x14, 0xC1);       // mov rdx, [rcx+rax*8]
+            if ((CFA_to_DFA(xt))->as_i == OP_RGT) {
+                EMIT(0xFF, 0xC8);               // dec eax
+                rs_store_top(c, 0);
+            }
+            push_reg(c, 2);
+            if ((CFA_to_DFA(xt))->as_i == OP_RAT_ZERO_GT) {
+                EMIT(0x4D, 0x85, 0xED);         // test r13, r13
+                EMIT(0x0F, 0x90 + CC_G, 0xC0);  // setg al
+                EMIT(0x4C, 0x0F, 0xB6, 0xE8);   // movzx r13, al
+            }
+            break;
+
+        case OP_QDO:
+            need(c, 2);
+            ds_load(c, 0, 1);
+            EMIT(0x4C, 0x39, 0xE8);             // cmp rax, r13
+            EMIT(0x75, 0x0D);                   // jne past the next 13 bytes
+            drop(c, 2);                         // 8
+            jmp(c, target);                     // 5
+            /* fall through */
+
+        case OP_DO:
+            need(c, 2);
+            rs_load(c);
+            rs_room(c, 2);
+            ds_load(c, 6, 1);                   // mov rsi, DS(1)
+            EMIT(0x48, 0x89, 0x74, 0xC1, 0x08); // mov [rcx+rax*8+8], rsi
+            EMIT(0x4C, 0x89, 0x6C, 0xC1, 0x10); // mov [rcx+rax*8+16], r13
+            rs_store_top(c, 2);
+            drop(c, 2);
+            break;
+
+        case OP_LOOP:
+            rs_load(c);
+            rs_need(c, 2);
+            EMIT(0x48, 0x8D, 0x14, 0xC1);       // lea rdx, [rcx+rax*8]
+            EMIT(0x48, 0x8B, 0x32);             // mov rsi, [rdx]
+            EMIT(0x48, 0xFF, 0xC6);             // inc rsi
+            EMIT(0x48, 0x89, 0x32);             // mov [rdx], rsi
+            EMIT(0x48, 0x3B, 0x72, 0xF8);       // cmp rsi, [rdx-8]
+            jcc(c, CC_NE, target);
+            EMIT(0x83, 0xE8, 0x02);             // sub eax, 2
+            rs_store_top(c, 0);
+            break;
+
+        case OP_PLUSLOOP:
+            need(c, 1);
+            EMIT(0x4C, 0x89, 0xEE);             // mov rsi, r13
+            drop(c, 1);
+            rs_load(c);
+            rs_need(c, 2);
+            EMIT(0x48, 0x8D, 0x14, 0xC1);       // lea rdx, [rcx+rax*8]
+            EMIT(0x4C, 0x8B, 0x02);             // mov r8, [rdx]
+            EMIT(0x4C, 0x2B, 0x42, 0xF8);       // sub r8, [rdx-8]         before
+            EMIT(0x4D, 0x8D, 0x0C, 0x30);       // lea r9, [r8+rsi]        after
+            EMIT(0x48, 0x01, 0x32);             // add [rdx], rsi
+            EMIT(0x4D, 0x31, 0xC1);             // xor r9, r8
+            EMIT(0x49, 0x31, 0xF0);             // xor r8, rsi
+            EMIT(0x4D, 0x21, 0xC1);             // and r9, r8
+            jcc(c, CC_NS, target);              // see do_colon
+            EMIT(0x83, 0xE8, 0x02);             // sub eax, 2
+            rs_store_top(c, 0);
+            break;
+
+        case OP_I:
+        case OP_J:
+            room(c, 1);
+            rs_load(c);
+            if ((CFA_to_DFA(xt))->as_i == OP_I) {
+                rs_need(c, 2);
+                EMIT(0x48, 0x8B, 0x14, 0xC1);   // mov rdx, [rcx+rax*8]
+            }
+            else {
+                rs_need(c, 4);
+                EMIT(0x48, 0x8B, 0x54, 0xC1, 0xF0); // mov rdx, [rcx+rax*8-16]
+            }
+            push_reg(c, 2);
+            break;
+
+        case OP_UNLOOP:
+            rs_load(c);
+            rs_need(c, 2);
+            EMIT(0x83, 0xE8, 0x02);             // sub eax, 2
+            rs_store_top(c, 0);
+            break;
+
+        case OP_TAIL:
+            tail_xt(c, p[1].as_xt, self);
+            break;
+
+        case OP_LIT_PLUS:
+            need(c, 1);
+            if (p[1].as_i == (int32_t) p[1].as_i) {
+                EMIT(0x49, 0x81, 0xC5);         // add r13, imm32
+                emit32(c, (int32_t) p[1].as_i);
+            }
+            else {
+                EMIT(0x48, 0xB8);               // mov rax, imm64
+                emit64(c, p[1].as_i);
+                EMIT(0x49, 0x01, 0xC5);         // add r13, rax
+            }
+            break;
+
+        case OP_DUP_FETCH:
+            need(c, 1);
+            room(c, 1);
+            EMIT(0x49, 0x8B, 0x45, 0x00);       // mov rax, [r13]
+            push_reg(c, 0);
+            break;
+
+        case OP_OVER_OVER:
+            need(c, 2);
+            room(c, 2);
+            ds_load(c, 0, 1);
+            push_reg(c, 0);
+            ds_load(c, 0, 1);
+            push_reg(c, 0);
+            break;
+
+        default:
+            c->failed = 1;                      // a new op this doesn't know
+            break;
+    }
+}
+
+
+// Spills, and throws exception, for the stack checks to jump to
+static void thrower (Code *c, size_t l, intptr_t exception) {
+    label(c, l);
+    spill(c);
+    EMIT(0x48, 0xC7, 0xC7);                     // mov rdi, imm32
+    emit32(c, (int32_t) exception);
+    call_abs(c, (const void *) throw);
+}
+
+
+// Generates the code for the colon definition with body [start, end), the last cell of
+// which is its final EXIT
+static int generate_word (Code *c, cell *start, cell *end, const pvf *self) {
+    DictEntry *de = CFA_to_DE(self);
+    cell *p, *next;
+
+    emit64(c, 0);                               // inner entry, filled in once it's placed
+    emit64(c, 0);
+
+    // The entry point for C
+    EMIT(0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);  // push rbx ... r15
+    EMIT(0x48, 0x83, 0xEC, 0x08);               // sub rsp, 8
+    call_abs(c, (const void *) jit_stacks);
+    EMIT(0x48, 0x89, 0xC3);                     // mov rbx, rax
+    EMIT(0x4C, 0x8D, 0xBB);                     // lea r15, [rbx+return_stack]
+    emit32(c, RS_DELTA);
+    EMIT(0x48, 0x63, 0x6B, OFF_SIZE);           // movsxd rbp, [rbx+size]
+    EMIT(0x48, 0xFF, 0xCD);                     // dec rbp
+    fill(c);
+    call_label(c, L_INNER);
+    spill(c);
+    EMIT(0x48, 0x83, 0xC4, 0x08);               // add rsp, 8
+    EMIT(0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B);  // pop r15 ... rbx
+    EMIT(0xC3);                                 // ret
+
+    // The entry point for native code
+    label(c, L_INNER);
+    EMIT(0x48, 0x83, 0xEC, 0x08);               // sub rsp, 8, so calls are 16 byte aligned
+    label(c, L_BODY);
+    if (de->flags2 & F2_EFFECT) {
+        if (de->effect_in > 0)  need(c, de->effect_in);
+        if (de->effect_max > de->effect_in)  room(c, de->effect_max - de->effect_in);
+        c->checked = 1;
+    }
+
+    for (p = start; p < end; p = next) {
+        if ((next = next_instruction(p)) == NULL || next > end)  return -1;
+        label(c, L_COUNT + (p - start));
+        generate(c, start, p, next < end ? next : p, self);
+    }
+    if (p != end)  return -1;
+
+    label(c, L_EXIT);
+    EMIT(0x48, 0x83, 0xC4, 0x08);               // add rsp, 8
+    EMIT(0xC3);                                 // ret
+
+    thrower(c, L_DS_UNDER, EXC_DS_UNDER);
+    thrower(c, L_DS_OVER, EXC_DS_OVER);
+    thrower(c, L_RS_UNDER, EXC_RS_UNDER);
+    thrower(c, L_RS_OVER, EXC_RS_OVER);
+    if (c->failed)  return -1;
+
+    for (size_t i = 0; i < c->njumps; i++) {
+        long to = c->labels[c->jumps[i].label];
+        if (to < 0)  return -1;                 // into the middle of an instruction
+        *(int32_t *)(c->bytes + c->jumps[i].at) = (int32_t)(to - (long)(c->jumps[i].at + 4));
+    }
+    return 0;
+}
+
+
+// Translates de, a colon definition that's just been finished, into native code and points
+// its code field at it.  Returns 0, or -1 if it can't, in which case de is left alone
+int jit_compile (DictEntry *de) {
+    cell *start = DE_to_DFA(de), *end = var_HERE->as_dfa;
+    Code code = { 0 };
+    char *native;
+    int status = -1;
+
+    if (de->code != do_colon || end <= start)  return -1;
+
+    code.nlabels = L_COUNT + (end - start) + 1;
+    if ((code.labels = malloc(code.nlabels * sizeof(*code.labels))) == NULL)  return -1;
+    for (size_t i = 0; i < code.nlabels; i++)  code.labels[i] = -1;
+
+    if (generate_word(&code, start, end, DE_to_CFA(de)) != 0)  goto done;
+    if ((native = jit_alloc(code.length)) == NULL)  goto done;
+
+    memcpy(native, code.bytes, code.length);
+    *(char **) native = native + code.labels[L_INNER];
+    de->code = (pvf)(native + 16);
+    status = 0;
+
+done:
+    free(code.bytes);
+    free(code.labels);
+    free(code.jumps);
+    return status;
+}
+
+#else
+
+int jit_compile (DictEntry *de) {
+    (void) de;
+    (void) jit_alloc;
+    return -1;
+}
+
+#endif
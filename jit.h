@@ -0,0 +1,22 @@
+#ifndef _JIT_H
+#define _JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cell.h"
+
+struct _dict_entry;
+
+typedef struct _jit_state {
+    char        *chunk;     /* the one code is being added to; each links to the one before */
+    size_t      used;       /* bytes of it */
+    size_t      size;
+} JitState;
+
+void jit_destroy ();
+int  jit_compile (struct _dict_entry *de);
+int  jit_contains (const void *p);
+
+
+#endif /* _JIT_H */
@@ -1,5 +1,10 @@
+#define _GNU_SOURCE  /* getrusage */
+
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
 
 #include "vm.h"
 #include "forth.h"
@@ -7,34 +12,171 @@
 
 DictDebug junk;  // Make sure DictDebug symbol does not optimise out
 
-Stack               data_stack;
-Stack               return_stack;
-Stack               control_stack;
-
 jmp_buf             cold_boot;
 jmp_buf             warm_boot;
 
+// What each VM started by -j does: include files, on top of the shared base
+typedef struct _job {
+    char        **files;
+    int         nfiles;
+    int         status;     /* 0 if every file was interpreted without an uncaught exception */
+} Job;
+
+static void usage (const char *argv0) {
+    fprintf(stderr, "usage: %s [-i image] [-r cells] [-s file]... [-j threads] [-t] [file ...]\n", argv0);
+    exit(1);
+}
+
+
+// -t: says how much processor time and memory the whole process used, as it exits
+static void report_usage () {
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)  return;
+    fprintf(stderr, "user_ms %ld sys_ms %ld maxrss_kb %ld\n",
+        (long) usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000,
+        (long) usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000,
+        usage.ru_maxrss);
+}
+
+
+// Interprets the file at path, exactly as INCLUDED would
+static void include (const char *path) {
+    DPUSH((cell)(void *) path);
+    DPUSH((cell)(uintptr_t) strlen(path));
+    _INCLUDED(NULL);
+}
+
+
+// Interprets files one after another.  Returns 0, or 1 as soon as one has an uncaught
+// exception (or QUITs).  Whoever runs the VM next must set its abort and quit jumps again
+static int include_all (char **files, int nfiles) {
+    if (setjmp(vm->task->abort_jmp) != 0)  goto failed;
+    if (setjmp(vm->task->quit_jmp) != 0)  goto failed;
+
+    for (int i = 0; i < nfiles; i++)  include(files[i]);
+    return 0;
+
+failed:
+    input_restore(0);  /* abandon any files still being included */
+    return 1;
+}
+
+
+// Runs a job in a VM of its own, which is thrown away afterwards.  Never reads stdin
+static void *run_job (void *arg) {
+    Job *job = arg;
+
+    vm_new();
+    job->status = include_all(job->files, job->nfiles);
+    vm_free(vm);
+    return NULL;
+}
+
+
+// Runs the same job in n threads at once.  Returns 0 if every one of them succeeded
+static int run_threads (const Job *job, int n) {
+    pthread_t *threads = calloc(n, sizeof(*threads));
+    Job *jobs = calloc(n, sizeof(*jobs));
+    int i, started, status = 0;
+
+    if (threads == NULL || jobs == NULL) {
+        perror("run_threads");
+        exit(1);
+    }
+
+    for (started = 0; started < n; started++) {
+        jobs[started] = *job;
+        if (pthread_create(&threads[started], NULL, run_job, &jobs[started]) != 0) {
+            fprintf(stderr, "run_threads: couldn't start thread %d\n", started);
+            status = 1;
+            break;
+        }
+    }
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        status |= jobs[i].status;
+    }
+
+    free(threads);
+    free(jobs);
+    return status;
+}
+
+
 int main (int argc, char **argv) {
+    Job job = { NULL, 0, 0 };
+    const char *image = NULL;
+    char **shared_files = calloc(argc, sizeof(*shared_files));  /* argc is plenty */
+    int nshared = 0;
+    int nthreads = 0;
+    intptr_t rsize = 0;
+    static int next_file = 0;  // survives longjmp
+    int i;
 
-    mem_init(0);
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)  image = argv[++i];
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && (rsize = atol(argv[++i])) > 0) ;
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)  shared_files[nshared++] = argv[++i];
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc && (nthreads = atoi(argv[++i])) > 0) ;
+        else if (strcmp(argv[i], "-t") == 0)  atexit(report_usage);
+        else  usage(argv[0]);
+    }
+    job.files = &argv[i];
+    job.nfiles = argc - i;
+
+    vm_new();
+
+    // Start from a saved dictionary rather than an empty one
+    if (image && image_load(image) != 0)  exit(1);
+
+    // A bigger (or smaller) return stack, for this VM and any made from it
+    if (rsize > 0) {
+        var_RSIZE->as_i = rsize;
+        if (stack_init(&vm->task->return_stack, rsize, EXC_RS_UNDER, EXC_RS_OVER) != 0) {
+            perror("-r");
+            exit(1);
+        }
+    }
+
+    // Freeze the image and the -s files into a base that every VM shares.  -j always does,
+    // so the threads don't each need a copy of the image
+    if (nshared > 0 || nthreads > 0) {
+        if (include_all(shared_files, nshared) != 0 || vm_share() != 0)  exit(1);
+    }
+    free(shared_files);
+
+    // Run the files in that many independent interpreters at once, and exit
+    if (nthreads > 0)  exit(run_threads(&job, nthreads));
 
     // do_abort jumps to here
-    if (setjmp(abort_jmp) != 0) {
-        dropline();  /* discard rest of input line if we longjmp'd here */
+    if (setjmp(vm->task->abort_jmp) != 0) {
+        profile_unwind();
+        input_restore(0);  /* abandon any files being included */
+        input_dropline();  /* discard rest of input line if we longjmp'd here */
     }
 
-    stack_init(&data_stack, EXC_DS_UNDER, EXC_DS_OVER);
+    stack_init(&vm->task->data_stack, STACK_SIZE, EXC_DS_UNDER, EXC_DS_OVER);
 
     // do_quit() jumps to here
-    if (setjmp(quit_jmp) != 0) {
-        dropline();  /* discard rest of input line if we longjmp'd here */
+    if (setjmp(vm->task->quit_jmp) != 0) {
+        profile_unwind();
+        input_restore(0);  /* abandon any files being included */
+        input_dropline();  /* discard rest of input line if we longjmp'd here */
     }
 
-    stack_init(&return_stack, EXC_RS_UNDER, EXC_RS_OVER);
-    stack_init(&control_stack, EXC_CS_UNDER, EXC_CS_OVER); 
+    // RSIZE may have changed since, so this may resize it
+    if (stack_init(&vm->task->return_stack, var_RSIZE->as_i, EXC_RS_UNDER, EXC_RS_OVER) != 0) {
+        perror("quit");
+        exit(1);
+    }
+    stack_init(&vm->task->control_stack, STACK_SIZE, EXC_CS_UNDER, EXC_CS_OVER); 
     exception_init();
-    interpreter_state = S_INTERPRET;
-    docolon_mode = DM_NORMAL;
+    vm->interpreter_state = S_INTERPRET;
+
+    // Files named on the command line come before stdin.  If one fails, carry on with the next
+    while (next_file < job.nfiles)  include(job.files[next_file++]);
 
     // Run the interpreter
     while (1) {
@@ -39,33 +39,84 @@
   * forth word to release space from the end of the region back to the system
     -> USHRINK
 
+  * function to replace the region with one mapped from a saved image
+    -> mem_load
+  * function to make sure there's room before writing at HERE, growing automatically
+    -> mem_ensure
+  * function to freeze the region into a base shared by every VM, and start a new one
+    -> mem_share
+
+  The region never moves.  mem_init reserves address space for MAX_USIZE cells up front,
+  without committing any memory to it, and then commits just the pages that are needed.
+  Growing commits more pages after the existing ones, and shrinking gives pages at the end
+  back to the system, so xts, DictEntry links and variable addresses within the region
+  stay valid for as long as the region does.  Being page aligned also lets a saved image
+  be mapped straight over the front of it.
+
+  Each VM has its own region.  mem_share makes the current VM's region read only, up to
+  HERE, and keeps it as the shared base for the rest of the process; the VM then starts
+  afresh on a new region of its own (its overlay), as does every VM made after it.  Nothing
+  in the base can be written to again, including any variables defined there.
 
 */
 
+#define _GNU_SOURCE  /* MAP_ANONYMOUS, MAP_NORESERVE */
+
 #include <stdio.h>  /* fprintf */
-#include <stdlib.h> /* malloc, realloc */
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "forth.h"
 #include "memory.h"
 
-/* Private state */
-static cell     *mem_start = NULL;
-static size_t   mem_ncells = 0;
+/* Private state, one per VM (see MemState in memory.h) */
+#define mem_start       (vm->mem.start)
+#define mem_ncells      (vm->mem.ncells)
+#define mem_reserved    (vm->mem.reserved)
+
+/* The shared base, if there is one.  It never changes once made */
+static cell     *base_start = NULL;
+static size_t   base_ncells = 0;
+
+
+// Bytes of whole pages needed to hold ncells
+static size_t mem_bytes (size_t ncells) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (sizeof(cell) * ncells + page - 1) & ~(page - 1);
+}
+
+
+// Reserves address space for at least MAX_USIZE cells, at hint if possible, and commits the
+// first ncells of it.  Returns NULL on failure
+static cell *mem_reserve (void *hint, size_t ncells, size_t *reserved) {
+    size_t len = mem_bytes(ncells > MAX_USIZE ? ncells : MAX_USIZE);
+    void *p;
+
+    p = mmap(hint, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)  return NULL;
+
+    if (mprotect(p, mem_bytes(ncells), PROT_READ | PROT_WRITE) != 0) {
+        munmap(p, len);
+        return NULL;
+    }
 
-/* These are copied from builtin.h, for easy reference while reading */
-extern cell * const var_UINCR;
-extern cell * const var_UTHRES;
-extern cell * const var_HERE;
+    *reserved = len;
+    return p;
+}
 
 
 // You would normally call this with ncells = INIT_USIZE
 void mem_init (size_t ncells) {
-    if (mem_start)  free(mem_start);
+    if (mem_start)  munmap(mem_start, mem_reserved);
 
     if (ncells == 0)  ncells = INIT_USIZE;
 
-    mem_start = malloc(sizeof(cell) * ncells);
-    // FIXME malloc error checking
+    mem_start = mem_reserve(NULL, ncells, &mem_reserved);
+    if (mem_start == NULL) {
+        perror("mem_init");
+        exit(1);
+    }
 
     mem_ncells = ncells;
     var_HERE->as_dfa = mem_start;
@@ -78,10 +129,11 @@ void mem_init (size_t ncells) {
 // Should only need to call this right before exit.  Use mem_init again 
 // to reinitialise while running
 void mem_destroy () {
-    if (mem_start)  free(mem_start);
+    if (mem_start)  munmap(mem_start, mem_reserved);
 
     mem_start = NULL;
     mem_ncells = 0;
+    mem_reserved = 0;
 
     var_HERE->as_dfa = mem_start;
 
@@ -90,8 +142,14 @@ void mem_destroy () {
 }
 
 
+// Cells from the start of the region up to HERE, rounded up
+static inline size_t mem_cells_used () {
+    return (var_HERE->as_u - (uintptr_t) mem_start + sizeof(cell) - 1) / sizeof(cell);
+}
+
+
 int mem_shouldgrow () {
-    size_t used_cells = (var_HERE->as_dfa - mem_start) / sizeof(cell);
+    size_t used_cells = mem_cells_used();
     if (mem_ncells - used_cells < var_UTHRES->as_u) {
         return 1;
     }
@@ -102,8 +160,8 @@ int mem_shouldgrow () {
 
 
 int mem_canshrink () {
-    size_t used_cells = (var_HERE->as_dfa - mem_start) / sizeof(cell);
-    if (used_cells < mem_ncells - var_UTHRES->as_u) {
+    size_t used_cells = mem_cells_used();
+    if (used_cells + var_UTHRES->as_u < mem_ncells) {
         return 1;
     }
     else {
@@ -112,75 +170,164 @@ int mem_canshrink () {
 }
 
 
+// Commits the region up to new_mem_ncells.  Returns 0 on success, -1 if it won't fit
+static int mem_commit (size_t new_mem_ncells) {
+    if (new_mem_ncells < mem_ncells || mem_bytes(new_mem_ncells) > mem_reserved)  return -1;
+
+    if (mprotect(mem_start, mem_bytes(new_mem_ncells), PROT_READ | PROT_WRITE) != 0)  return -1;
+
+    mem_ncells = new_mem_ncells;
+    return 0;
+}
+
+
+/*
+  Called by anything that's about to write nbytes at HERE.  If that would leave fewer than
+  UTHRES cells free, the region grows by UINCR cells or by its own current size, whichever
+  is larger, so a long compile only grows it a logarithmic number of times.  Near the end
+  of the reservation it settles for whatever's left.  Throws EXC_DICT_OVER if even nbytes
+  won't fit.
+*/
+void mem_ensure (size_t nbytes) {
+    size_t used = mem_cells_used();
+    size_t need = used + (nbytes + sizeof(cell) - 1) / sizeof(cell);
+    size_t want = need + var_UTHRES->as_u;
+    size_t incr = var_UINCR->as_u > mem_ncells ? var_UINCR->as_u : mem_ncells;
+    size_t limit = mem_reserved / sizeof(cell);
+
+    if (want <= mem_ncells)  return;
+
+    if (want < mem_ncells + incr)  want = mem_ncells + incr;
+    if (want > limit)  want = limit;
+    if (need > want || mem_commit(want) != 0) {
+        throw(EXC_DICT_OVER);  /* doesn't return */
+    }
+}
+
+
 // You would normally call this with ncells = *var_UINCR
 int mem_grow (size_t ncells) {
-    cell *new_mem_start;
     size_t new_mem_ncells = mem_ncells + ncells;
 
     fprintf(stderr, "Attempting to grow user memory by %zu cells (%zu bytes)... ",
         ncells, sizeof(cell) * ncells);
-    new_mem_start = realloc(mem_start, sizeof(cell) * new_mem_ncells);
-    if (new_mem_start == NULL) {
-        // realloc failed
-        // original pointer is STILL GOOD, so don't change anything 
-        // (but we might run out of memory soon)
-        // FIXME maybe print a warning or something
-        fprintf(stderr, "failed!\n");
+    if (mem_commit(new_mem_ncells) != 0) {
+        // Nothing has changed, but we might run out of memory soon
+        fprintf(stderr, "failed! (the limit is %zu bytes)\n", mem_reserved);
         return -1;
     }
-    else if (new_mem_start != mem_start) {
-        // realloc succeeded, but our memory region has moved
-        size_t here_offset = var_HERE->as_dfa - mem_start;
-        mem_start = new_mem_start;
-        mem_ncells = new_mem_ncells;
-        var_HERE->as_dfa = mem_start + here_offset;
-        fprintf(stderr, "succeeded (with relocation)\n");
-    }
-    else {
-        // realloc succeeded, memory region is in the same place but is just longer
-        mem_ncells = new_mem_ncells;
-        fprintf(stderr, "succeeded (in place)\n");
-    }
+
+    fprintf(stderr, "succeeded\n");
     return 0;
 }
 
 
 int mem_shrink (size_t ncells) {
-    cell *new_mem_start;
     size_t new_mem_ncells = mem_ncells - ncells;
+    size_t keep, release;
 
     // Refuse to release cells if doing so would invalidate HERE
-    if ((mem_start + sizeof(cell) * new_mem_ncells) <= *(cell**)var_HERE) {
+    if (ncells > mem_ncells || mem_start + new_mem_ncells < var_HERE->as_dfa) {
         fprintf(stderr, "Rejected attempt to shrink user memory while still in use\n");    
         return -1;
     }
 
     fprintf(stderr, "Attempting to shrink user memory by %zu cells (%zu bytes)... ",
         ncells, sizeof(cell) * ncells);
-    new_mem_start = realloc(mem_start, sizeof(cell) * new_mem_ncells);
-    if (new_mem_start == NULL) {
-        // Shrinking reallocation failed, WTF
-        // Original Pointer is still good, so don't change anything
-        // FIXME maybe print a warning or something
-        fprintf(stderr, "failed! (wtf)\n");
+
+    // Only whole pages past the new end can go.  Mapping fresh PROT_NONE pages over them
+    // discards their contents and uncommits them, while keeping the address space reserved
+    keep = mem_bytes(new_mem_ncells);
+    release = mem_bytes(mem_ncells) - keep;
+    if (release > 0 && mmap((char *) mem_start + keep, release, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        perror("failed!");
+        return -1;
+    }
+
+    mem_ncells = new_mem_ncells;
+    fprintf(stderr, "succeeded\n");
+    return 0;
+}
+
+
+/*
+  Replaces the region with a fresh one of ncells, whose first nbytes are mapped privately
+  from fd at offset (which must be page aligned).  It's placed at hint if the system will
+  allow it.  HERE is left for the caller to set.
+
+  Returns the new start of the region, or NULL (with the old region untouched) on failure.
+*/
+cell *mem_load (int fd, off_t offset, size_t nbytes, size_t ncells, void *hint) {
+    cell *new_mem_start;
+    size_t new_mem_reserved;
+
+    if (nbytes > sizeof(cell) * ncells)  return NULL;
+
+    if ((new_mem_start = mem_reserve(hint, ncells, &new_mem_reserved)) == NULL)  return NULL;
+
+    if (nbytes > 0 && mmap(new_mem_start, nbytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_FIXED, fd, offset) == MAP_FAILED) {
+        munmap(new_mem_start, new_mem_reserved);
+        return NULL;
     }
-    else if (new_mem_start != mem_start) {
-        // I cannot think of a scenario where it would need to relocate to shrink?
-        size_t here_offset = var_HERE->as_dfa - mem_start;
-        mem_start = new_mem_start;
-        mem_ncells = new_mem_ncells;
-        * (cell**) var_HERE = mem_start + here_offset;
-        fprintf(stderr, "succeeded (with relocation -- wtf)\n");
+
+    if (mem_start)  munmap(mem_start, mem_reserved);
+    mem_start = new_mem_start;
+    mem_ncells = ncells;
+    mem_reserved = new_mem_reserved;
+    return mem_start;
+}
+
+
+/*
+  Makes the region read only up to HERE, and keeps it as the shared base, then starts this
+  VM on a new region.  Returns 0 on success, or -1 (having said why on stderr) if nothing
+  changed.  There can only be one base, and it must be made before any other VM is.
+*/
+int mem_share () {
+    size_t used = mem_cells_used();
+    size_t keep = mem_bytes(used);
+
+    if (base_start) {
+        fprintf(stderr, "mem_share: there's already a shared base\n");
+        return -1;
     }
-    else {
-        // realloc succeeded, memory region is in the same place but is shorter
-        mem_ncells = new_mem_ncells;
-        fprintf(stderr, "succeeded (in place)\n");
+
+    if (mprotect(mem_start, keep, PROT_READ) != 0) {
+        perror("mem_share");
+        return -1;
     }
+    if (keep < mem_reserved)  munmap((char *) mem_start + keep, mem_reserved - keep);
+
+    base_start = mem_start;
+    base_ncells = used;
+
+    mem_start = NULL;  // so mem_init doesn't unmap it
+    mem_init(0);
     return 0;
 }
 
 
+// Is p in the shared base?
+int mem_in_base (const void *p) {
+    return base_ncells && (const cell *) p >= base_start && (const cell *) p < base_start + base_ncells;
+}
+
+
+// If HERE has been put back into the shared base (by running a MARKER that was defined
+// there), everything this VM had of its own is forgotten: start its region over
+void mem_check_here () {
+    if (mem_in_base(var_HERE->as_ptr))  var_HERE->as_dfa = mem_start;
+}
+
+
+// Returns the size of the shared base, in cells; 0 if there isn't one
+size_t mem_get_base_ncells () {
+    return base_ncells;
+}
+
+
 // Returns the address where the user memory starts.  
 // This is safe -- it's *not* returning the address of our private pointer 
 // to it (so we're not exposed to external modification), but merely the 
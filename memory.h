@@ -1,6 +1,13 @@
 #ifndef _MEMORY_H
 #define _MEMORY_H
 
+#include <sys/types.h>
+
+typedef struct _mem_state {
+    cell        *start;
+    size_t      ncells;     /* committed, as far as anyone else is concerned */
+    size_t      reserved;   /* bytes of address space held from start */
+} MemState;
 
 void mem_init ();
 void mem_destroy ();
@@ -8,6 +15,12 @@ int  mem_shouldgrow ();
 int  mem_canshrink ();
 int  mem_grow (size_t ncells);
 int  mem_shrink (size_t ncells);
+void mem_ensure (size_t nbytes);
+int  mem_share ();
+int  mem_in_base (const void *p);
+void mem_check_here ();
+size_t mem_get_base_ncells ();
+cell *mem_load (int fd, off_t offset, size_t nbytes, size_t ncells, void *hint);
 cell *mem_get_start ();
 size_t mem_get_ncells ();
 
@@ -0,0 +1,192 @@
+/*
+
+  Output.
+
+  Everything the VM prints to stdout goes through a buffer of its own rather than stdio's:
+  EMIT and CR add a character, TELL and TYPE copy the whole string in at once, and .R and
+  U.R convert numbers straight into it.  It's written out with write(2) when it fills up,
+  when FLUSH says so, and before the VM is freed or the process exits.  When stdout is a
+  terminal it's also written at the end of each line, and before a line is read from stdin,
+  so prompts and partial lines show up when they should.
+
+  Each VM has its own buffer, so the jobs -j runs don't interleave any finer than that.
+  Anything else in the process that writes to stdout through stdio must output_flush()
+  first (SAMPLE-REPORT does), or it'll come out ahead of what was buffered before it.
+
+*/
+
+#define _POSIX_C_SOURCE 200809L  /* isatty, write */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "forth.h"
+#include "output.h"
+
+/* Private state, one per VM (see OutputState in output.h) */
+#define buffer      (vm->output.buffer)
+#define used        (vm->output.used)
+#define size        (vm->output.size)
+#define tty         (vm->output.tty)
+
+
+// Writes all of len bytes to stdout, or as much as it will take before it fails
+static void write_all (const char *s, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, s, len);
+
+        if (n < 0) {
+            if (errno == EINTR)  continue;
+            return;  // like stdio, carry on regardless: there's nowhere to say so
+        }
+        s += n;
+        len -= n;
+    }
+}
+
+
+// The VM that's current as the process exits still has something to say
+static void flush_at_exit () {
+    if (vm)  output_flush();
+}
+
+
+void output_init () {
+    static int registered = 0;
+
+    if (!registered) {
+        atexit(flush_at_exit);
+        registered = 1;
+    }
+
+    buffer = malloc(OUTPUT_SIZE);
+    size = buffer ? OUTPUT_SIZE : 0;
+    used = 0;
+    tty = isatty(STDOUT_FILENO);
+}
+
+
+// Writes out whatever's left, and frees the buffer
+void output_destroy () {
+    output_flush();
+    free(buffer);
+    buffer = NULL;
+    size = 0;
+}
+
+
+void output_flush () {
+    if (used == 0)  return;
+
+    fflush(stdout);  // in case anything did get there through stdio first
+    write_all(buffer, used);
+    used = 0;
+}
+
+
+void output_write (const char *s, size_t len) {
+    if (len == 0)  return;
+    if (len > size - used) {
+        output_flush();
+        // Too big to be worth copying
+        if (len > size) {
+            write_all(s, len);
+            return;
+        }
+    }
+
+    memcpy(buffer + used, s, len);
+    used += len;
+    if (tty && memchr(s, '\n', len))  output_flush();
+}
+
+
+void output_char (int c) {
+    if (used == size) {
+        output_flush();
+        if (size == 0) {
+            char ch = c;
+
+            write_all(&ch, 1);
+            return;
+        }
+    }
+
+    buffer[used++] = c;
+    if (tty && c == '\n')  output_flush();
+}
+
+
+void output_spaces (size_t n) {
+    static const char spaces[] = "                                ";
+
+    while (n > 0) {
+        size_t chunk = n < sizeof(spaces) - 1 ? n : sizeof(spaces) - 1;
+
+        output_write(spaces, chunk);
+        n -= chunk;
+    }
+}
+
+
+/*
+  Converts n to digits in base (2 to 36), right aligned in width characters, writing them
+  backwards from the end of the space they'll take in the buffer.  If is_signed, a negative
+  n gets a '-'; otherwise it's taken as unsigned.
+*/
+void output_number (intptr_t n, int is_signed, unsigned base, size_t width) {
+    static const char charset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    int neg = is_signed && n < 0;
+    uintptr_t u = neg ? -(uintptr_t) n : (uintptr_t) n;
+    char digits[1 + 8 * sizeof(u)];  // for when there's no buffer to write them into
+    size_t len = neg;
+    char *p;
+
+    for (uintptr_t v = u; ; v /= base) {
+        len++;
+        if (v < base)  break;
+    }
+    if (width > len)  output_spaces(width - len);
+
+    if (len > size - used)  output_flush();
+    p = (size ? buffer + used : digits) + len;
+    do {
+        *--p = charset[u % base];
+        u /= base;
+    } while (u);
+    if (neg)  *--p = '-';
+
+    if (size)  used += len;
+    else  write_all(digits, len);
+}
+
+
+void output_printf (const char *format, ...) {
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    len = vsnprintf(buffer + used, size - used, format, args);
+    va_end(args);
+    if (len < 0)  return;
+
+    if ((size_t) len >= size - used) {
+        // It didn't fit: make room and do it again
+        char *s = malloc(len + 1);
+
+        if (s == NULL)  return;
+        va_start(args, format);
+        vsnprintf(s, len + 1, format, args);
+        va_end(args);
+        output_write(s, len);
+        free(s);
+        return;
+    }
+
+    used += len;
+    if (tty && memchr(buffer + used - len, '\n', len))  output_flush();
+}
@@ -0,0 +1,26 @@
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OUTPUT_SIZE     (64 * 1024)     /* bytes buffered before they're written */
+
+typedef struct _output_state {
+    char        *buffer;                /* NULL if it couldn't be had: then nothing's buffered */
+    size_t      used;
+    size_t      size;
+    int         tty;                    /* stdout is a terminal: flush at each newline */
+} OutputState;
+
+void output_init ();
+void output_destroy ();
+void output_flush ();
+void output_write (const char *s, size_t len);
+void output_char (int c);
+void output_spaces (size_t n);
+void output_number (intptr_t n, int is_signed, unsigned base, size_t width);
+void output_printf (const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+
+
+#endif /* _OUTPUT_H */
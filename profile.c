@@ -0,0 +1,769 @@
+/*
+
+  Timing words as they run.
+
+  PROFILE-ON starts counting, for every word that's called, how many times it was called
+  and how long was spent in it: its self time, which excludes the words it called in turn,
+  and its inclusive time, which doesn't.  PROFILE-REPORT prints the words that took the
+  most self time, PROFILE-OFF stops counting and PROFILE-RESET forgets the counts.
+
+  A word is "called" when do_colon nests into it, when it's a primitive (or anything else
+  that's not threaded code) that do_colon calls, and when it's run from C, by the outer
+  interpreter, EXECUTE, CATCH and so on (see execute() in vm.h).  The threaded-code
+  operations (LIT, BRANCH, DUP, + etc) aren't calls: their time is their caller's.  Words
+  compiled to native code (see jit.c) are timed as a whole, like primitives, and what they
+  call isn't seen at all, so set JIT to 0 before compiling anything to be looked at closely.
+
+  Each task keeps a stack of the calls in progress (ProfileStack, in its Task).  Whenever
+  one starts or finishes, the time since the last one did is charged to the innermost as
+  self time; and when one finishes, the time since it started is added to its inclusive
+  time, unless it's recursive and an outer call to it is still in progress (in any task,
+  so a word that several tasks are in at once, like PAUSE, is undercounted).  A call nested
+  by do_colon is tagged with its return stack index, and EXIT only finishes the innermost
+  call if it was nested there: anything that was started before PROFILE-ON, or had its
+  frames thrown past, just doesn't match.  Calls from C finish when the C does, taking
+  anything a THROW left above them with them.
+
+  Times are read from the processor's time stamp counter where there is one, and scaled to
+  nanoseconds by comparing it to the clock over the whole time since the counts were reset.
+
+  None of this costs anything much while it's off: do_colon copies the flag into a register,
+  and tests it on the way into and out of other words.  The counts are only allocated by
+  the first PROFILE-ON.
+
+*/
+
+#define _GNU_SOURCE  /* clock_gettime, setitimer */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "forth.h"
+#include "profile.h"
+#include "vm.h"
+
+#define PROFILE_TABLE_SIZE  (1 << 12)   /* must be a power of 2 */
+#define SAMPLE_CELLS        (1 << 20)   /* room for the distinct samples */
+#define SAMPLE_SLOTS        (1 << 14)   /* must be a power of 2 */
+#define SAMPLE_HZ           (997)       /* by default: not in step with anything periodic */
+
+typedef struct _profile_count {
+    DictEntry   *de;
+    uintmax_t   calls;
+    uint64_t    self;                   /* ticks */
+    uint64_t    inclusive;
+    uintmax_t   active;                 /* calls in progress */
+} ProfileCount;
+
+typedef struct _sample_slot {
+    uint32_t    hash;
+    uint32_t    length;                 /* cells, 0 if the slot's free */
+    size_t      offset;                 /* in samples */
+    uintmax_t   count;
+} SampleSlot;
+
+/* Private state, one per VM (see ProfileState in profile.h) */
+#define on          (vm->profile.on)
+#define generation  (vm->profile.generation)
+#define counts      (vm->profile.counts)
+#define dropped     (vm->profile.dropped)
+#define last        (vm->profile.last)
+#define ticks0      (vm->profile.ticks0)
+#define ns0         (vm->profile.ns0)
+#define samples     (vm->profile.samples)
+#define samples_used    (vm->profile.samples_used)
+#define slots       (vm->profile.slots)
+#define samples_dropped (vm->profile.samples_dropped)
+
+/* SIGPROF is per process, so the timer runs while any VM is sampling */
+static pthread_mutex_t sampler_lock = PTHREAD_MUTEX_INITIALIZER;
+static int samplers = 0;
+
+
+// Nanoseconds from some fixed point in the past, that only ever goes forwards (NS-TIME)
+uint64_t profile_ns () {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+
+// Microseconds since the epoch, by the wall clock (UTIME)
+uint64_t profile_utime () {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+
+// The time stamp counter, if there is one, or else profile_ns() (CYCLES)
+uint64_t profile_ticks () {
+#if defined(__x86_64__) && defined(__GNUC__)
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+#else
+    return profile_ns();
+#endif
+}
+
+
+// Frees the counts and samples, if there were any
+void profile_destroy () {
+    sample_stop();
+    free(counts);
+    counts = NULL;
+    dropped = 0;
+    free(samples);
+    free(slots);
+    samples = NULL;
+    slots = NULL;
+    samples_used = 0;
+    samples_dropped = 0;
+    on = 0;
+}
+
+
+void profile_start () {
+    if (on & PROFILE_TIMING)  return;
+
+    // Anything in progress from last time isn't any more
+    generation++;
+    if (counts) {
+        for (size_t i = 0; i < PROFILE_TABLE_SIZE; i++)  counts[i].active = 0;
+    }
+    if (ticks0 == 0) {
+        ticks0 = profile_ticks();
+        ns0 = profile_ns();
+    }
+    last = profile_ticks();
+    on |= PROFILE_TIMING;
+}
+
+
+void profile_stop () {
+    on &= ~PROFILE_TIMING;
+}
+
+
+void profile_reset () {
+    if (counts)  memset(counts, 0, PROFILE_TABLE_SIZE * sizeof(*counts));
+    dropped = 0;
+    generation++;
+    ticks0 = profile_ticks();
+    ns0 = profile_ns();
+    last = ticks0;
+}
+
+
+static ProfileCount *profile_count (DictEntry *de) {
+    register size_t h, i;
+
+    if (counts == NULL && (counts = calloc(PROFILE_TABLE_SIZE, sizeof(*counts))) == NULL) {
+        dropped++;
+        return NULL;
+    }
+
+    h = ((uintptr_t) de >> 3) & (PROFILE_TABLE_SIZE - 1);
+    for (i = 0; i < PROFILE_TABLE_SIZE; i++, h = (h + 1) & (PROFILE_TABLE_SIZE - 1)) {
+        if (counts[h].de == de)  return &counts[h];
+        if (counts[h].de == NULL) {
+            counts[h].de = de;
+            return &counts[h];
+        }
+    }
+
+    dropped++;  // table's full
+    return NULL;
+}
+
+
+// The running task's calls in progress, emptied if they're from before the last PROFILE-ON
+static inline ProfileStack *profile_stack () {
+    ProfileStack *s = &vm->task->profile;
+
+    if (s->seen != generation) {
+        s->top = 0;
+        s->seen = generation;
+    }
+    return s;
+}
+
+
+// Charges the time since the last call started or finished to the innermost one
+static inline uint64_t profile_charge (ProfileStack *s) {
+    uint64_t now = profile_ticks();
+
+    if (s->top > 0 && s->frames[s->top - 1].count)
+        s->frames[s->top - 1].count->self += now - last;
+    last = now;
+    return now;
+}
+
+
+// Finishes the calls in progress above top
+static void profile_finish (ProfileStack *s, size_t top) {
+    uint64_t now;
+
+    if (s->top <= top)  return;
+
+    now = profile_charge(s);
+    while (s->top > top) {
+        ProfileFrame *f = &s->frames[--s->top];
+
+        if (f->count && f->count->active > 0 && --f->count->active == 0)
+            f->count->inclusive += now - f->start;
+    }
+}
+
+
+// Starts a call to xt, nested by do_colon at return stack index depth (or PROFILE_CALLED)
+void profile_enter (const pvf *xt, size_t depth) {
+    ProfileStack *s = profile_stack();
+    ProfileFrame *f;
+
+    if (s->top == s->capacity) {
+        size_t new_capacity = s->capacity ? 2 * s->capacity : 256;
+        ProfileFrame *new_frames = realloc(s->frames, new_capacity * sizeof(*new_frames));
+
+        if (new_frames == NULL) {
+            dropped++;
+            return;
+        }
+        s->frames = new_frames;
+        s->capacity = new_capacity;
+    }
+
+    f = &s->frames[s->top];
+    f->start = profile_charge(s);
+    f->depth = depth;
+    if ((f->count = profile_count(CFA_to_DE(xt))) != NULL) {
+        f->count->calls++;
+        f->count->active++;
+    }
+    s->top++;
+}
+
+
+// do_colon EXITs at return stack index depth: finishes the innermost call if it was that one
+void profile_exit (size_t depth) {
+    ProfileStack *s = profile_stack();
+
+    if (s->top > 0 && s->frames[s->top - 1].depth == depth)  profile_finish(s, s->top - 1);
+}
+
+
+// do_colon jumps into xt in place of the word nested at depth
+void profile_tail (const pvf *xt, size_t depth) {
+    profile_exit(depth);
+    profile_enter(xt, depth);
+}
+
+
+// Runs xt from C, as one call.  Anything it leaves behind (by THROWing) is dropped after
+void profile_call (const pvf *xt) {
+    Task *task = vm->task;
+    ProfileStack *s = &task->profile;
+    const cell *where = s->where;
+    size_t ncalls = s->ncalls, top = 0;
+    int timing = on & PROFILE_TIMING;
+
+    if (ncalls < PROFILE_MAX_CALLS)
+        s->calls[ncalls] = (ProfileCall) { xt, where, task->return_stack.top };
+    BARRIER();  // the sampler mustn't see the call before it's filled in
+    s->ncalls = ncalls + 1;
+    if (timing) {
+        top = profile_stack()->top;
+        profile_enter(xt, PROFILE_CALLED);
+    }
+
+    (**xt)(CFA_to_DFA(xt));
+
+    if (timing && (on & PROFILE_TIMING))  profile_finish(profile_stack(), top);
+    PROFILE_CHANGING(s, s->ncalls = ncalls; s->where = where);
+}
+
+
+// Finishes every call the running task has in progress, when it's done or has been QUIT
+void profile_unwind () {
+    if (on & PROFILE_TIMING)  profile_finish(profile_stack(), 0);
+    vm->task->profile.ncalls = 0;
+    vm->task->profile.where = NULL;
+}
+
+
+static int compare_self (const void *a, const void *b) {
+    uint64_t sa = ((const ProfileCount *) a)->self;
+    uint64_t sb = ((const ProfileCount *) b)->self;
+
+    return (sa < sb) - (sa > sb);
+}
+
+
+// Prints the n words that took the most self time
+void profile_report (size_t n) {
+    ProfileCount *sorted;
+    size_t count = 0;
+    uint64_t total = 0, ticks = profile_ticks() - ticks0, ns = profile_ns() - ns0;
+    double ms_per_tick = (ticks ? (double) ns / ticks : 1.0) / 1e6;
+
+    if (counts == NULL) {
+        output_printf("nothing profiled (PROFILE-ON starts)\n");
+        return;
+    }
+
+    if ((sorted = malloc(PROFILE_TABLE_SIZE * sizeof(*sorted))) == NULL) {
+        perror("PROFILE-REPORT");
+        return;
+    }
+
+    for (size_t i = 0; i < PROFILE_TABLE_SIZE; i++) {
+        if (counts[i].de && counts[i].calls) {
+            sorted[count++] = counts[i];
+            total += counts[i].self;
+        }
+    }
+    qsort(sorted, count, sizeof(*sorted), compare_self);
+
+    output_printf("%12s %12s %6s %12s  %s\n", "calls", "self ms", "self%", "incl ms", "name");
+    for (size_t i = 0; i < count && i < n; i++) {
+        DictEntry *de = sorted[i].de;
+
+        output_printf("%12ju %12.3f %6.2f %12.3f  %.*s\n", sorted[i].calls,
+            sorted[i].self * ms_per_tick,
+            total ? 100.0 * sorted[i].self / total : 0.0,
+            sorted[i].inclusive * ms_per_tick,
+            de->flags & F_LENMASK, de->name);
+    }
+    output_printf("%12s %12.3f\n", "total", total * ms_per_tick);
+    if (dropped)  output_printf("(%ju calls not counted, out of memory or table full)\n", dropped);
+
+    free(sorted);
+}
+
+
+/*
+  BENCH runs xt n times, BENCH_RUNS times over, after once to warm up.  Each run is timed,
+  and so is running an empty definition as many times, and the median of that is taken off
+  the median run as the cost of the loop itself.  xt should leave the data stack as it found
+  it: if it doesn't, that's reported, and whatever it left is dropped.
+*/
+#define BENCH_RUNS  (5)
+
+// A colon definition with nothing in it, that's not in the dictionary
+static const cell bench_empty[2] = { { .as_pvf = do_colon }, { .as_i = 0 } };
+
+
+typedef struct _bench_time {
+    uint64_t    ns;
+    uint64_t    ticks;
+} BenchTime;
+
+
+static BenchTime bench_run (const pvf *xt, intptr_t n) {
+    BenchTime start = { profile_ns(), profile_ticks() };
+
+    for (intptr_t i = 0; i < n; i++)  (**xt)(CFA_to_DFA(xt));
+    return (BenchTime) { profile_ns() - start.ns, profile_ticks() - start.ticks };
+}
+
+
+static int compare_bench_times (const void *a, const void *b) {
+    uint64_t na = ((const BenchTime *) a)->ns, nb = ((const BenchTime *) b)->ns;
+
+    return (na > nb) - (na < nb);
+}
+
+
+void profile_bench (const pvf *xt, intptr_t n) {
+    const pvf *empty = (const pvf *) &bench_empty[0].as_pvf;
+    Stack *ds = &vm->task->data_stack;
+    int32_t before = ds->top + 1, after;
+    BenchTime times[BENCH_RUNS], overheads[BENCH_RUNS], median, overhead;
+    double ns, ticks;
+
+    if (n < 1)  n = 1;
+
+    bench_run(empty, n);
+    bench_run(xt, 1);
+    after = ds->top + 1;
+    if (after > before)  ds->top = before - 1;
+
+    if (after == before) {
+        bench_run(xt, n - 1);
+        for (int i = 0; i < BENCH_RUNS; i++) {
+            overheads[i] = bench_run(empty, n);
+            times[i] = bench_run(xt, n);
+        }
+        qsort(times, BENCH_RUNS, sizeof(*times), compare_bench_times);
+        qsort(overheads, BENCH_RUNS, sizeof(*overheads), compare_bench_times);
+
+        median = times[BENCH_RUNS / 2];
+        overhead = overheads[BENCH_RUNS / 2];
+        ns = median.ns > overhead.ns ? (double)(median.ns - overhead.ns) / n : 0.0;
+        ticks = median.ticks > overhead.ticks ? (double)(median.ticks - overhead.ticks) / n : 0.0;
+
+        output_printf("%jd x %d runs: min %.3f ms, median %.3f ms, loop %.3f ms: %.2f ns, %.1f cycles each\n",
+            (intmax_t) n, BENCH_RUNS, times[0].ns / 1e6, median.ns / 1e6, overhead.ns / 1e6,
+            ns, ticks);
+    }
+    output_printf("data stack: %d before, %d after%s\n", (int) before, (int) after,
+        after == before ? "" : " -- not timed, it should leave the stack as it was");
+}
+
+
+/*
+  The sampler, which doesn't time anything itself: SIGPROF interrupts whichever thread is
+  using the processor, SAMPLE-ON times a second, and if its VM is sampling, the handler
+  copies out where the running task has got to.  Identical samples are counted rather than
+  stored again, so a long job only needs room for the different places it goes.
+
+  Where a task has got to is three things.  Its return stack, whose return addresses say
+  which word each nested call came from.  profile.where, which do_colon points into the
+  word it's running whenever it nests, returns or jumps (but not at every instruction --
+  which word it's in is all that's wanted).  And profile.calls, which runs from C started
+  (execute() and do_colon's calls out go through profile_call() while anything's on), with
+  where their callers had got to and how deep the return stack was.  None of them can be
+  changed all at once, so whoever changes them does it inside PROFILE_CHANGING, and a
+  signal that comes in part way through leaves the sample to be taken just after.
+
+  SAMPLE-REPORT turns the addresses into dictionary entries using a sorted array of them:
+  each address belongs to the newest entry below it.  A cell on the return stack is taken
+  for a return address only if the one before it is a word's xt, which leaves out loop
+  counters and most else that's been pushed with >R.  Words forgotten since a sample was
+  taken can't be named properly.  Native code (see jit.c) has no return addresses to write:
+  it zeroes the cells its calls take instead, so a native word is just the word that was
+  called into, and what it calls in turn isn't seen.
+*/
+
+
+static uint32_t sample_hash (const cell *p, size_t n) {
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < n; i++)  h = (h ^ (uint32_t)(p[i].as_u ^ (p[i].as_u >> 32))) * 16777619u;
+    return h;
+}
+
+
+// Records where the running task has got to
+static void sample_take () {
+    Task *task = vm->task;
+    ProfileStack *s = &task->profile;
+    cell *p;
+    size_t ncalls, depth, n, h;
+    uint32_t hash;
+
+    ncalls = s->ncalls < PROFILE_MAX_CALLS ? s->ncalls : PROFILE_MAX_CALLS;
+    depth = task->return_stack.top + 1;
+    n = 2 + 3 * ncalls + depth;
+    if (samples_used + n > SAMPLE_CELLS) {
+        samples_dropped++;
+        return;
+    }
+
+    // Written where it would go if it's new
+    p = samples + samples_used;
+    p[0] = CELL(ncalls);
+    p[1].as_ptr = (void *) s->where;
+    for (size_t i = 0; i < ncalls; i++) {
+        p[2 + 3 * i].as_ptr = (void *) s->calls[i].xt;
+        p[3 + 3 * i].as_ptr = (void *) s->calls[i].where;
+        p[4 + 3 * i] = CELL(s->calls[i].depth);
+    }
+    memcpy(p + 2 + 3 * ncalls, task->return_stack.values, depth * sizeof(cell));
+
+    hash = sample_hash(p, n);
+    h = hash & (SAMPLE_SLOTS - 1);
+    for (size_t i = 0; i < SAMPLE_SLOTS; i++, h = (h + 1) & (SAMPLE_SLOTS - 1)) {
+        SampleSlot *slot = &slots[h];
+
+        if (slot->length == 0) {
+            *slot = (SampleSlot) { hash, n, samples_used, 1 };
+            samples_used += n;
+            return;
+        }
+        if (slot->hash == hash && slot->length == n
+            && memcmp(samples + slot->offset, p, n * sizeof(cell)) == 0) {
+            slot->count++;
+            return;
+        }
+    }
+    samples_dropped++;  // table's full
+}
+
+
+// SIGPROF: records where the running task has got to, if this thread's VM is sampling.  If
+// do_colon is part way through changing that (see PROFILE_CHANGING), it's left to do so
+// as soon as it's finished, rather than record a stack that never was
+static void sample_signal (int sig) {
+    int saved_errno = errno;
+
+    (void) sig;
+    if (vm != NULL && (on & PROFILE_SAMPLING) && samples != NULL) {
+        if (vm->task->profile.changing)  vm->task->profile.deferred = 1;
+        else  sample_take();
+    }
+    errno = saved_errno;
+}
+
+
+// Starts sampling hz times a second of processor time (or SAMPLE_HZ, if hz isn't positive).
+// Returns 0, or -1 (having said why)
+int sample_start (intptr_t hz) {
+    struct itimerval timer = { { 0, 0 }, { 0, 0 } };
+    struct sigaction action;
+
+    if (hz <= 0)  hz = SAMPLE_HZ;
+    if (hz > 1000000)  hz = 1000000;
+
+    if (samples == NULL) {
+        samples = malloc(SAMPLE_CELLS * sizeof(*samples));
+        slots = calloc(SAMPLE_SLOTS, sizeof(*slots));
+        if (samples == NULL || slots == NULL) {
+            perror("SAMPLE-ON");
+            free(samples);
+            free(slots);
+            samples = NULL;
+            slots = NULL;
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&sampler_lock);
+    if (!(on & PROFILE_SAMPLING) && samplers++ == 0) {
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = sample_signal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, NULL);
+    }
+    on |= PROFILE_SAMPLING;
+
+    timer.it_interval.tv_usec = 1000000 / hz;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0)  perror("SAMPLE-ON");
+    pthread_mutex_unlock(&sampler_lock);
+    return 0;
+}
+
+
+// Stops this VM sampling.  The handler stays, in case a signal's still on its way
+void sample_stop () {
+    struct itimerval timer = { { 0, 0 }, { 0, 0 } };
+
+    if (!(on & PROFILE_SAMPLING))  return;
+
+    pthread_mutex_lock(&sampler_lock);
+    on &= ~PROFILE_SAMPLING;
+    if (--samplers == 0)  setitimer(ITIMER_PROF, &timer, NULL);
+    pthread_mutex_unlock(&sampler_lock);
+}
+
+
+// Keeps SIGPROF off this thread while its samples are looked at, or back on
+static void sample_block (int how) {
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    pthread_sigmask(how, &set, NULL);
+}
+
+
+// Takes the sample SIGPROF put off, now where the task has got to makes sense again
+void sample_deferred () {
+    sample_block(SIG_BLOCK);
+    vm->task->profile.deferred = 0;
+    if ((on & PROFILE_SAMPLING) && samples != NULL)  sample_take();
+    sample_block(SIG_UNBLOCK);
+}
+
+
+void sample_reset () {
+    sample_block(SIG_BLOCK);
+    if (slots)  memset(slots, 0, SAMPLE_SLOTS * sizeof(*slots));
+    samples_used = 0;
+    samples_dropped = 0;
+    sample_block(SIG_UNBLOCK);
+}
+
+
+/* Every entry in the dictionary, by address */
+typedef struct _sample_index {
+    DictEntry   **entries;
+    size_t      count;
+} SampleIndex;
+
+
+static int compare_addresses (const void *a, const void *b) {
+    uintptr_t pa = (uintptr_t) *(DictEntry * const *) a;
+    uintptr_t pb = (uintptr_t) *(DictEntry * const *) b;
+
+    return (pa > pb) - (pa < pb);
+}
+
+
+static int sample_index (SampleIndex *index) {
+    size_t count = 0;
+
+    for (DictEntry *de = var_LATEST->as_de; de; de = de->link)  count++;
+    if ((index->entries = malloc(count * sizeof(*index->entries))) == NULL)  return -1;
+
+    index->count = 0;
+    for (DictEntry *de = var_LATEST->as_de; de; de = de->link) {
+        if (de->flags & F_LENMASK)  index->entries[index->count++] = de;
+    }
+    qsort(index->entries, index->count, sizeof(*index->entries), compare_addresses);
+    return 0;
+}
+
+
+// The entry whose definition p points into, or NULL
+static DictEntry *sample_word (const SampleIndex *index, const void *p) {
+    size_t lo = 0, hi = index->count;
+    DictEntry *de;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if ((const void *) index->entries[mid] <= p)  lo = mid + 1;
+        else  hi = mid;
+    }
+    if (lo == 0)  return NULL;
+
+    de = index->entries[lo - 1];
+    return (const cell *) p >= DE_to_DFA(de) ? de : NULL;
+}
+
+
+// The entry that the return address p goes back into, or NULL if it doesn't look like one
+static DictEntry *sample_caller (const SampleIndex *index, const cell *p) {
+    DictEntry *de = sample_word(index, p), *callee;
+
+    if (de == NULL || p - 1 < DE_to_DFA(de))  return NULL;
+
+    callee = sample_word(index, CFA_to_DFA(p[-1].as_xt));
+    return callee && DE_to_CFA(callee) == p[-1].as_xt ? de : NULL;
+}
+
+
+static char *sample_name (char *out, const DictEntry *de) {
+    for (int i = 0; i < (de->flags & F_LENMASK); i++)
+        *out++ = (de->name[i] == ';' ? ':' : de->name[i]);  // ; separates them
+    *out++ = ';';
+    return out;
+}
+
+
+/* A sample's stack, folded into one line */
+typedef struct _folded {
+    char        *stack;
+    uintmax_t   count;
+} Folded;
+
+
+// Names the words in a sample, outermost first.  Returns a string to free, or NULL
+static char *sample_fold (const SampleIndex *index, const cell *p, size_t n) {
+    size_t ncalls = p[0].as_u, depth = n - 2 - 3 * ncalls, k = 0;
+    const cell *calls = p + 2, *rs = p + 2 + 3 * ncalls;
+    char *stack = malloc((ncalls + depth + 1) * (F_LENMASK + 1) + sizeof("[interpreter]"));
+    char *out = stack;
+    DictEntry *de;
+
+    if (stack == NULL)  return NULL;
+
+    // Each call from C starts a run of nested calls.  The first return address of the
+    // run goes back into the word called, so it's already been named
+    for (size_t run = 0; run <= ncalls; run++) {
+        intptr_t end = (run < ncalls ? calls[3 * run + 2].as_i : (intptr_t) depth - 1);
+        const cell *where = (run < ncalls ? calls[3 * run + 1].as_dfa : p[1].as_dfa);
+        size_t nested = 0;
+
+        if (run > 0)  out = sample_name(out, CFA_to_DE(calls[3 * (run - 1)].as_xt));
+        for (; k < depth && (intptr_t) k <= end; k++) {
+            if ((de = sample_caller(index, rs[k].as_dfa)) == NULL)  continue;
+            if (run == 0 || nested++ > 0)  out = sample_name(out, de);
+        }
+        if ((run == 0 || nested > 0) && where && (de = sample_word(index, where)))
+            out = sample_name(out, de);
+    }
+
+    if (out == stack)  out = stpcpy(stack, "[interpreter];");
+    out[-1] = '\0';
+    return stack;
+}
+
+
+static int compare_folded (const void *a, const void *b) {
+    return strcmp(((const Folded *) a)->stack, ((const Folded *) b)->stack);
+}
+
+
+// Writes the samples so far to path (stdout if it's empty) as folded stacks, one per line
+// with how many times it was seen, as flamegraph.pl etc want them.  Returns 0, or -1
+int sample_report (const char *path) {
+    SampleIndex index = { NULL, 0 };
+    Folded *folded = NULL;
+    size_t count = 0;
+    FILE *out = stdout;
+    int status = 0;
+
+    sample_block(SIG_BLOCK);
+
+    if (!*path)  output_flush();  // stdio's turn, after whatever's been printed already
+    if (*path && (out = fopen(path, "w")) == NULL) {
+        perror(path);
+        status = -1;
+        goto done;
+    }
+    if (slots == NULL)  goto done;
+
+    if (sample_index(&index) != 0
+        || (folded = malloc(SAMPLE_SLOTS * sizeof(*folded))) == NULL) {
+        perror("SAMPLE-REPORT");
+        status = -1;
+        goto done;
+    }
+
+    for (size_t i = 0; i < SAMPLE_SLOTS; i++) {
+        if (slots[i].length == 0)  continue;
+        if ((folded[count].stack = sample_fold(&index, samples + slots[i].offset, slots[i].length)) == NULL) {
+            perror("SAMPLE-REPORT");
+            status = -1;
+            goto done;
+        }
+        folded[count++].count = slots[i].count;
+    }
+    qsort(folded, count, sizeof(*folded), compare_folded);
+
+    // Different samples can still be in the same words
+    for (size_t i = 0; i < count; i++) {
+        uintmax_t total = folded[i].count;
+
+        while (i + 1 < count && strcmp(folded[i].stack, folded[i + 1].stack) == 0)
+            total += folded[++i].count;
+        fprintf(out, "%s %ju\n", folded[i].stack, total);
+    }
+    if (samples_dropped)  fprintf(stderr, "(%ju samples not kept, out of room)\n", samples_dropped);
+
+done:
+    for (size_t i = 0; i < count; i++)  free(folded[i].stack);
+    free(folded);
+    free(index.entries);
+    if (out != stdout && out != NULL && fclose(out) != 0) {
+        perror(path);
+        status = -1;
+    }
+    if (out == stdout)  fflush(stdout);
+    sample_block(SIG_UNBLOCK);
+    return status;
+}
@@ -0,0 +1,101 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cell.h"
+
+#define PROFILE_CALLED  ((size_t) -1)   /* a frame's depth, when it was called from C */
+#define PROFILE_MAX_CALLS   (64)        /* calls from C a sample can see through */
+
+/* Keeps the compiler from moving loads and stores across it, which is all the sampler
+   needs: its signal interrupts the thread whose stacks it reads */
+#if defined(__GNUC__)
+#define BARRIER()           __asm__ __volatile__ ("" ::: "memory")
+#else
+#define BARRIER()           ((void) 0)
+#endif
+
+/* Runs STATEMENTS, which change where a task is (ProfileStack.where, .ncalls, and the top
+   of its return stack), so that a sample that comes in part way through waits until after */
+#define PROFILE_CHANGING(S, STATEMENTS)                                 \
+    do {                                                                \
+        (S)->changing = 1;                                              \
+        BARRIER();                                                      \
+        STATEMENTS;                                                     \
+        BARRIER();                                                      \
+        (S)->changing = 0;                                              \
+        BARRIER();                                                      \
+        if ((S)->deferred)  sample_deferred();                          \
+    } while (0)
+
+/* What ProfileState.on says is going on */
+#define PROFILE_TIMING      (1)
+#define PROFILE_SAMPLING    (2)
+
+struct _profile_count;
+struct _sample_slot;
+
+typedef struct _profile_frame {
+    struct _profile_count *count;       /* NULL if the table was full */
+    uint64_t    start;
+    size_t      depth;                  /* return stack index it was nested at */
+} ProfileFrame;
+
+// A word run from C (by execute() or do_colon), and where the one that ran it had got to
+typedef struct _profile_call {
+    const pvf   *xt;
+    const cell  *where;
+    intptr_t    depth;                  /* return_stack.top at the time */
+} ProfileCall;
+
+// Each task's words in progress, innermost last
+typedef struct _profile_stack {
+    ProfileFrame *frames;
+    size_t      top;
+    size_t      capacity;
+    unsigned    seen;                   /* the generation its frames are from */
+    const cell  *where;                 /* in the word do_colon is running, for the sampler */
+    int         changing;               /* while where and the return stack disagree */
+    int         deferred;               /* SIGPROF came while they did, see PROFILE_CHANGING */
+    size_t      ncalls;
+    ProfileCall calls[PROFILE_MAX_CALLS];
+} ProfileStack;
+
+typedef struct _profile_state {
+    int         on;                     /* PROFILE_TIMING and/or PROFILE_SAMPLING */
+    unsigned    generation;             /* bumped by PROFILE-ON, so old frames are ignored */
+    struct _profile_count *counts;
+    uintmax_t   dropped;
+    uint64_t    last;                   /* when the time since was last charged to a word */
+    uint64_t    ticks0;                 /* since the counts were reset, for calibration */
+    uint64_t    ns0;
+    cell        *samples;               /* each distinct one, as the signal handler saw it */
+    size_t      samples_used;           /* cells */
+    struct _sample_slot *slots;         /* hash of them, with how many times each was seen */
+    uintmax_t   samples_dropped;
+} ProfileState;
+
+uint64_t profile_ns ();
+uint64_t profile_utime ();
+uint64_t profile_ticks ();
+void profile_destroy ();
+void profile_start ();
+void profile_stop ();
+void profile_reset ();
+void profile_report (size_t n);
+void profile_enter (const pvf *xt, size_t depth);
+void profile_exit (size_t depth);
+void profile_tail (const pvf *xt, size_t depth);
+void profile_call (const pvf *xt);
+void profile_unwind ();
+void profile_bench (const pvf *xt, intptr_t n);
+int  sample_start (intptr_t hz);
+void sample_stop ();
+void sample_deferred ();
+void sample_reset ();
+int  sample_report (const char *path);
+
+
+#endif /* _PROFILE_H */
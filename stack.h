@@ -2,6 +2,7 @@
 #define _STACK_H
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "cell.h"
@@ -15,21 +16,42 @@ extern void throw (intptr_t);
 
 typedef struct _stack {
     int32_t top;
+    int32_t size;   /* cells values has room for */
     int underflow;
     int overflow;
-    #define STACK_SIZE (256)
-    cell values[STACK_SIZE];
+    cell *values;   /* values[-1] exists too: lets do_colon spill its cached top to an empty stack */
 } Stack;
 
-static inline void stack_init (Stack *stack, int underflow, int overflow) {
-    memset(stack, 0, sizeof (Stack));
+#define STACK_SIZE      (256)       /* data and control stacks */
+#define MAX_STACK_SIZE  (1 << 24)
+
+// Empties stack, (re)allocating it if it isn't already size cells.  Returns 0, or -1 if
+// there isn't the memory, in which case the stack is as it was
+static inline int stack_init (Stack *stack, int32_t size, int underflow, int overflow) {
+    if (size < 1)  size = 1;
+    if (size > MAX_STACK_SIZE)  size = MAX_STACK_SIZE;
+
+    if (stack->values == NULL || stack->size != size) {
+        cell *mem = realloc(stack->values ? stack->values - 1 : NULL, (size + 1) * sizeof(cell));
+        if (mem == NULL)  return -1;
+        stack->values = mem + 1;
+        stack->size = size;
+    }
     stack->top = STACK_EMPTY;
     stack->underflow = underflow;
     stack->overflow = overflow;
+    return 0;
+}
+
+static inline void stack_free (Stack *stack) {
+    if (stack->values)  free(stack->values - 1);
+    stack->values = NULL;
+    stack->size = 0;
+    stack->top = STACK_EMPTY;
 }
 
 static inline void stack_push (Stack *stack, cell value) {
-    if (stack->top >= STACK_SIZE - 1)  throw(stack->overflow);
+    if (stack->top >= stack->size - 1)  throw(stack->overflow);
     stack->values[++stack->top] = value;
 }
 
@@ -48,14 +70,14 @@ static inline uintptr_t stack_count (const Stack *stack) {
 }
 
 static inline void stack_pick (Stack *stack, unsigned int n) {
-    if (stack->top >= STACK_SIZE - 1)  throw(stack->overflow);
+    if (stack->top >= stack->size - 1)  throw(stack->overflow);
     if (stack->top <= STACK_EMPTY + n)  throw(stack->underflow);
     stack->values[stack->top + 1] = stack->values[stack->top - n];
     ++ stack->top;
 }
 
 static inline void stack_roll (Stack *stack, unsigned int n) {
-    if (stack->top >= STACK_SIZE - 1)  throw(stack->overflow);
+    if (stack->top >= stack->size - 1)  throw(stack->overflow);
     if (stack->top <= STACK_EMPTY + n)  throw(stack->underflow);
     register cell a = stack->values[stack->top - n];
     memmove(&stack->values[stack->top - n],     // dst
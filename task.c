@@ -0,0 +1,365 @@
+/*
+
+  Cooperative tasks.
+
+  A VM runs any number of tasks, one at a time, and only switches from one to another when
+  the running task PAUSEs, STOPs or finishes.  Tasks share the dictionary, user memory, the
+  builtin variables and the input source.  Each has its own data, return and control
+  stacks and exception frames (its Task), and its own C stack too, because PAUSE is called
+  from inside do_colon (and EXECUTE, CATCH etc nest it further).
+
+  Switching tasks is just pushing the callee-saved registers onto the C stack of the task
+  being left, saving its stack pointer, loading the next task's, and popping its registers
+  back off (task_switch, below).  vm->task is repointed at the same time, and since every
+  stack access goes through it, there's nothing else to copy.  No setjmp, no system call.
+  Architectures without a task_switch here fall back to swapcontext(), which is slower.
+
+  The main task is the interpreter itself, on the thread's own stack.  It can't sleep, so
+  there's always somewhere to switch to.  The tasks that are awake form a ring, and PAUSE
+  moves on to the next one round it.  TASK makes a task asleep; WAKE puts it into the ring
+  just behind the current one, so it runs once everything else has had a turn; and STOP
+  takes the current task out of the ring.  A task that returns from its xt, or has an
+  uncaught exception (or ABORTs or QUITs), is done.  Its stacks are freed by whichever
+  task runs next, since it can't unmap the C stack it's standing on.
+
+*/
+
+#define _GNU_SOURCE  /* MAP_ANONYMOUS, MAP_NORESERVE, ucontext */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "forth.h"
+#include "vm.h"
+#include "task.h"
+
+#define TASK_STACK_SIZE     (256 * 1024)    /* C stack, only committed as it's touched */
+
+#if !defined(__x86_64__) && !defined(TASK_UCONTEXT)
+#define TASK_UCONTEXT
+#endif
+
+#ifdef TASK_UCONTEXT
+#include <ucontext.h>
+#endif
+
+/* Private state, one per VM (see TaskState in task.h) */
+#define table       (vm->tasks.table)
+#define count       (vm->tasks.count)
+#define capacity    (vm->tasks.capacity)
+#define live        (vm->tasks.live)
+#define zombie      (vm->tasks.zombie)
+
+static void task_entry ();
+
+
+#ifndef TASK_UCONTEXT
+/*
+  void task_switch (void **save_sp, void *sp)
+
+  Saves the callee-saved registers on the current stack and the stack pointer in *save_sp,
+  then switches to sp and restores the registers that were saved there.  The ret goes back
+  to wherever that task called task_switch from -- or, the first time, to task_entry.
+*/
+void task_switch (void **save_sp, void *sp);
+__asm__ (
+    "    .text\n"
+    "    .globl  task_switch\n"
+    "    .type   task_switch, @function\n"
+    "task_switch:\n"
+    "    pushq   %rbp\n"
+    "    pushq   %rbx\n"
+    "    pushq   %r12\n"
+    "    pushq   %r13\n"
+    "    pushq   %r14\n"
+    "    pushq   %r15\n"
+    "    movq    %rsp, (%rdi)\n"
+    "    movq    %rsi, %rsp\n"
+    "    popq    %r15\n"
+    "    popq    %r14\n"
+    "    popq    %r13\n"
+    "    popq    %r12\n"
+    "    popq    %rbx\n"
+    "    popq    %rbp\n"
+    "    ret\n"
+    "    .size   task_switch, .-task_switch\n"
+);
+
+
+// Lays out the top of a new task's C stack as if it had called task_switch from task_entry
+static int task_prepare (Task *t, char *stack_top) {
+    void **sp = (void **)((uintptr_t) stack_top & ~(uintptr_t) 15);
+
+    *--sp = NULL;                   // task_entry's own return address: it never returns
+    *--sp = (void *) task_entry;    // where task_switch's ret goes
+    for (int i = 0; i < 6; i++)  *--sp = NULL;  // rbp, rbx, r12-r15
+    t->sp = sp;
+    return 0;
+}
+
+
+static inline void task_jump (Task *from, Task *to) {
+    task_switch(&from->sp, to->sp);
+}
+
+
+static void task_release (Task *t) {
+    (void) t;
+}
+
+#else
+/* Anything else: sp points to a ucontext_t instead */
+
+static int task_prepare (Task *t, char *stack_top) {
+    ucontext_t *context = malloc(sizeof(*context));
+
+    if (context == NULL || getcontext(context) != 0) {
+        free(context);
+        return -1;
+    }
+    context->uc_stack.ss_sp = t->cstack;
+    context->uc_stack.ss_size = stack_top - (char *) t->cstack;
+    context->uc_link = NULL;
+    makecontext(context, task_entry, 0);
+
+    t->sp = context;
+    return 0;
+}
+
+
+static inline void task_jump (Task *from, Task *to) {
+    swapcontext(from->sp, to->sp);
+}
+
+
+static void task_release (Task *t) {
+    free(t->sp);
+    t->sp = NULL;
+}
+#endif
+
+
+static void task_free (Task *t) {
+    task_release(t);
+    task_free_stacks(t);
+    munmap(t->cstack, TASK_STACK_SIZE);
+    free(t);
+}
+
+
+// Frees a task that's done, if there is one.  Never the one that's running
+static void task_reap () {
+    if (zombie == NULL)  return;
+
+    task_free(zombie);
+    zombie = NULL;
+}
+
+
+static void task_switch_to (Task *to) {
+    Task *from = vm->task;
+
+    vm->task = to;
+    task_jump(from, to);
+
+    // Back in from, whenever some task switches to it again
+    task_reap();
+}
+
+
+// Takes t out of the ring of awake tasks
+static void task_unlink (Task *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = t;
+}
+
+
+// The first thing every task but the main one runs, on its own stack
+static void task_entry () {
+    Task *self = vm->task;
+
+    task_reap();
+
+    // An uncaught exception, ABORT or QUIT ends the task, rather than the whole interpreter
+    if (setjmp(self->abort_jmp) != 0)  goto done;
+    if (setjmp(self->quit_jmp) != 0)  goto done;
+
+    execute(self->xt);  // checked by TASK
+
+done:
+    {
+        Task *next = self->next;
+
+        profile_unwind();
+        self->status = TASK_DONE;
+        table[self->id - 1] = NULL;
+        live--;
+        task_unlink(self);
+
+        zombie = self;
+        task_switch_to(next);  /* doesn't return */
+    }
+}
+
+
+// Makes the main task, which is the only one to start with
+void task_init () {
+    Task *t = &vm->main_task;
+
+    vm->task = t;
+    t->id = 0;
+    t->status = TASK_AWAKE;
+    t->next = t->prev = t;
+
+#ifdef TASK_UCONTEXT
+    if ((t->sp = malloc(sizeof(ucontext_t))) == NULL) {
+        perror("task_init");
+        exit(1);
+    }
+#endif
+}
+
+
+// Frees every task.  Only the main task can do this, and it carries on alone
+void task_destroy () {
+    task_reap();
+
+    for (size_t i = 0; i < count; i++) {
+        if (table[i])  task_free(table[i]);
+    }
+    free(table);
+    table = NULL;
+    count = capacity = live = 0;
+
+    vm->main_task.next = vm->main_task.prev = &vm->main_task;
+#ifdef TASK_UCONTEXT
+    free(vm->main_task.sp);
+    vm->main_task.sp = NULL;
+#endif
+}
+
+
+// Empties t's stacks, with a return stack of RSIZE cells.  Returns 0, or -1 if there
+// isn't the memory for them
+int task_init_stacks (Task *t) {
+    if (stack_init(&t->data_stack, STACK_SIZE, EXC_DS_UNDER, EXC_DS_OVER) != 0
+        || stack_init(&t->return_stack, var_RSIZE->as_i, EXC_RS_UNDER, EXC_RS_OVER) != 0
+        || stack_init(&t->control_stack, STACK_SIZE, EXC_CS_UNDER, EXC_CS_OVER) != 0)
+        return -1;
+
+    t->exceptions.top = STACK_EMPTY;
+    return 0;
+}
+
+
+void task_free_stacks (Task *t) {
+    stack_free(&t->data_stack);
+    stack_free(&t->return_stack);
+    stack_free(&t->control_stack);
+    free(t->profile.frames);
+    t->profile = (ProfileStack) { NULL };
+}
+
+
+// Makes a task, asleep, that will run xt when woken.  Returns its id, or -1 (having said why)
+intptr_t task_new (const pvf *xt) {
+    long page = sysconf(_SC_PAGESIZE);
+    Task *t;
+
+    if (count == capacity) {
+        size_t new_capacity = capacity ? 2 * capacity : 64;
+        Task **new_table = realloc(table, new_capacity * sizeof(*table));
+        if (new_table == NULL) {
+            perror("task_new");
+            return -1;
+        }
+        table = new_table;
+        capacity = new_capacity;
+    }
+
+    if ((t = calloc(1, sizeof(*t))) == NULL) {
+        perror("task_new");
+        return -1;
+    }
+
+    t->cstack = mmap(NULL, TASK_STACK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (t->cstack == MAP_FAILED) {
+        perror("task_new");
+        free(t);
+        return -1;
+    }
+    mprotect(t->cstack, page, PROT_NONE);  // guard page, so overflowing it faults
+
+    if (task_init_stacks(t) != 0) {
+        perror("task_new");
+        task_free_stacks(t);
+        munmap(t->cstack, TASK_STACK_SIZE);
+        free(t);
+        return -1;
+    }
+
+    if (task_prepare(t, (char *) t->cstack + TASK_STACK_SIZE) != 0) {
+        perror("task_new");
+        task_free_stacks(t);
+        munmap(t->cstack, TASK_STACK_SIZE);
+        free(t);
+        return -1;
+    }
+
+    t->xt = xt;
+    t->status = TASK_ASLEEP;
+    t->next = t->prev = t;
+
+    table[count++] = t;
+    t->id = count;
+    live++;
+    return t->id;
+}
+
+
+// Puts a sleeping task into the ring, to run after all the others.  Returns 0, or -1 if
+// there's no such task (any more)
+int task_wake (intptr_t id) {
+    Task *t, *current = vm->task;
+
+    if (id < 1 || (size_t) id > count || (t = table[id - 1]) == NULL)  return -1;
+    if (t->status == TASK_AWAKE)  return 0;
+
+    t->next = current;
+    t->prev = current->prev;
+    current->prev->next = t;
+    current->prev = t;
+    t->status = TASK_AWAKE;
+    return 0;
+}
+
+
+// Lets the next awake task run.  Returns when this one's turn comes round again
+void task_pause () {
+    if (vm->task->next != vm->task)  task_switch_to(vm->task->next);
+}
+
+
+// Puts this task to sleep until something WAKEs it.  The main task just pauses
+void task_stop () {
+    Task *current = vm->task, *next = current->next;
+
+    if (current == &vm->main_task) {
+        task_pause();
+        return;
+    }
+
+    current->status = TASK_ASLEEP;
+    task_unlink(current);
+    task_switch_to(next);
+}
+
+
+// Tasks that aren't done yet, not counting the main one
+size_t task_count () {
+    return live;
+}
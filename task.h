@@ -0,0 +1,55 @@
+#ifndef _TASK_H
+#define _TASK_H
+
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cell.h"
+#include "exception.h"
+#include "profile.h"
+#include "stack.h"
+
+typedef enum {
+    TASK_ASLEEP = 0,
+    TASK_AWAKE,
+    TASK_DONE,
+} TaskStatus;
+
+typedef struct _task {
+    Stack           data_stack;
+    Stack           return_stack;
+    Stack           control_stack;
+    ExceptionStack  exceptions;
+    ProfileStack    profile;        /* its calls in progress, see profile.c */
+    jmp_buf         abort_jmp;      /* vm_abort() lands here */
+    jmp_buf         quit_jmp;       /* vm_quit() lands here */
+    void            *sp;            /* saved C stack pointer, while switched out */
+    void            *cstack;        /* its own C stack; NULL for the main task */
+    const pvf       *xt;            /* what it runs */
+    intptr_t        id;             /* what TASK returned for it; 0 for the main task */
+    TaskStatus      status;
+    struct _task    *next;          /* round the ring of awake tasks */
+    struct _task    *prev;
+} Task;
+
+typedef struct _task_state {
+    Task            **table;        /* by id - 1; NULL once that task is done */
+    size_t          count;          /* ids handed out so far */
+    size_t          capacity;
+    size_t          live;           /* tasks not done yet, besides the main one */
+    Task            *zombie;        /* done, waiting to be freed from some other stack */
+} TaskState;
+
+void task_init ();
+void task_destroy ();
+int  task_init_stacks (Task *t);
+void task_free_stacks (Task *t);
+intptr_t task_new (const pvf *xt);
+int  task_wake (intptr_t id);
+void task_pause ();
+void task_stop ();
+size_t task_count ();
+
+
+#endif /* _TASK_H */
@@ -0,0 +1,17 @@
+#!/bin/sh
+# A file that ends inside a ( comment must still finish: KEY gives -1 at the end of an
+# included file, and ( used to wait for a ) forever.
+# Usage: tests/comment_eof.sh, or make check
+
+FROTH=${FROTH:-./froth}
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+printf '1 . ( x ( y ) z ) 2 . CR 3 . ( unterminated' > "$TMP/comment.fs"
+out=$(timeout 10 $FROTH base.fs "$TMP/comment.fs" </dev/null)
+status=$?
+if [ $status -ne 0 ] || [ "$out" != "$(printf '1 2 \n3 ')" ]; then
+    echo "comment_eof: exit status $status, printed \"$out\"" >&2
+    exit 1
+fi
+echo "comment_eof: ok"
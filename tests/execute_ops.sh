@@ -0,0 +1,30 @@
+#!/bin/sh
+# Threaded operations that push onto the return stack (>R, (DO), (?DO)) must work when
+# they're EXECUTEd rather than compiled, interpreted and compiled to native code alike.
+# do_threaded used to run them with a trailing EXIT, which popped what they'd pushed as a
+# return address and crashed.
+# Usage: tests/execute_ops.sh, or make check
+
+FROTH=${FROTH:-./froth}
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/ops.fs" <<'END'
+: T1 5 [ ' >R ] LITERAL EXECUTE R> . ;
+: T2 5 6 [ ' 2>R ] LITERAL EXECUTE R> R> . . ;
+: T3 10 0 [ ' (DO) ] LITERAL EXECUTE R> R> . . ;
+: T4 10 0 [ ' (?DO) ] LITERAL EXECUTE R> R> . .  3 3 [ ' (?DO) ] LITERAL EXECUTE 7 . ;
+T1 T2 T3 T4 CR
+END
+expected="5 5 6 10 0 10 0 7 "
+
+for jit in 0 1; do
+    echo "$jit JIT !" > "$TMP/jit.fs"
+    out=$($FROTH base.fs "$TMP/jit.fs" "$TMP/ops.fs" </dev/null)
+    status=$?
+    if [ $status -ne 0 ] || [ "$out" != "$expected" ]; then
+        echo "execute_ops: JIT=$jit: exit status $status, printed \"$out\", expected \"$expected\"" >&2
+        exit 1
+    fi
+done
+echo "execute_ops: ok"
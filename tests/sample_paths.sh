@@ -0,0 +1,44 @@
+#!/bin/sh
+# The sampler must only report call paths that really happen.  SQ is only ever called from
+# W, and W from LONG, so every folded stack has to be a prefix of RUN;LONG;W;SQ.  A sample
+# taken while do_colon is part way through nesting or returning used to come out as
+# LONG;SQ or LONG;W;W.
+#
+# Compiled to native code, the same words have no return addresses to show, so RUN is
+# all there is.  They're run interpreted first, to leave return addresses behind in the
+# cells the native calls take, which the sampler used to read as LONG or W.
+# Usage: tests/sample_paths.sh, or make check
+
+FROTH=${FROTH:-./froth}
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/words.fs" <<'END'
+: SQ DUP * ;
+: W 1000 0 DO I SQ DROP LOOP ;
+: LONG 3000 0 DO W LOOP ;
+: RUN 20 0 DO LONG LOOP ;
+END
+cat > "$TMP/sample.fs" <<'END'
+: REPORT S" " SAMPLE-REPORT ;
+10000 SAMPLE-ON RUN SAMPLE-OFF REPORT
+END
+echo "LONG 1 JIT !" > "$TMP/jit.fs"
+
+# check name pattern file... : every folded stack froth prints for the files must match
+check () {
+    name=$1 pattern=$2
+    shift 2
+    $FROTH base.fs "$@" </dev/null >"$TMP/folded" || { echo "sample_paths: $name: $FROTH failed" >&2; exit 1; }
+    awk -v name="$name" -v pattern="$pattern" '
+        { samples += $NF }
+        $1 !~ pattern { print "sample_paths: " name ": impossible stack: " $0; bad++ }
+        END {
+            if (samples == 0) { print "sample_paths: " name ": no samples"; exit 1 }
+            exit bad > 0
+        }' "$TMP/folded" >&2 || exit 1
+}
+
+check interpreted '^RUN(;LONG(;W(;SQ)?)?)?$' "$TMP/words.fs" "$TMP/sample.fs"
+check native '^RUN$' "$TMP/words.fs" "$TMP/jit.fs" "$TMP/words.fs" "$TMP/sample.fs"
+echo "sample_paths: ok"
@@ -2,6 +2,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "exception.h"
 #include "vm.h"
@@ -25,15 +26,97 @@
  *                                                 \-> (etc)
  */
 
-jmp_buf abort_jmp;
-jmp_buf quit_jmp;
+/* These are copied from builtin.h/builtin.c, for easy reference while reading */
+extern DictEntry _dict_var_LATEST;
+extern DictEntry _dict___ROOT;
 
-InterpreterState    interpreter_state;
-DocolonMode         docolon_mode;
+__thread VM *vm = NULL;
 
-static cell last_key;
+/* The builtin variables as they were when the shared base was made, if it has been */
+static int  shared = 0;
+static cell shared_user[USER_COUNT];
 
-extern DictEntry _dict__LIT;  /* from builtin.c */
+
+/*
+  Creates a VM with empty stacks, its own user memory and a dictionary of just the builtins
+  (or the shared base, if there is one), and makes it the calling thread's current one.
+  Exits if there isn't the memory for it.
+*/
+VM *vm_new () {
+    VM *new_vm = calloc(1, sizeof(*new_vm));
+
+    if (new_vm == NULL) {
+        perror("vm_new");
+        exit(1);
+    }
+    vm = new_vm;
+
+    // Every builtin variable starts with the value in its entry, or where the base left it
+    if (shared) {
+        memcpy(vm->user, shared_user, sizeof(vm->user));
+    }
+    else {
+        for (DictEntry *de = &_dict_var_LATEST; de != &_dict___ROOT; de = de->link) {
+            if (de->code == do_user)  vm->user[de->param[0].as_u] = de->param[1];
+        }
+    }
+
+    task_init();
+    if (task_init_stacks(vm->task) != 0) {
+        perror("vm_new");
+        exit(1);
+    }
+    exception_init();
+    vm->interpreter_state = S_INTERPRET;
+
+    mem_init(0);
+    dict_init();
+    input_init();
+    output_init();
+
+    return vm;
+}
+
+
+/*
+  Freezes everything the current VM has defined so far into a base that's shared, read only,
+  by every VM made from now on.  Rather than starting from the builtins alone, they start
+  from the base, with only a small region and index of their own for whatever they define
+  on top of it.  The current VM carries on the same way.  This must be done before any
+  other VM is made, and only once.  Returns 0 on success, or -1 (having said why).
+*/
+int vm_share () {
+    if (shared) {
+        fprintf(stderr, "vm_share: there's already a shared base\n");
+        return -1;
+    }
+    if (mem_share() != 0)  return -1;
+    dict_share();
+
+    memcpy(shared_user, vm->user, sizeof(shared_user));
+    shared = 1;
+    return 0;
+}
+
+
+// Releases everything old_vm owns.  If it was the current VM, there no longer is one
+void vm_free (VM *old_vm) {
+    VM *saved = vm;
+
+    vm = old_vm;
+    output_destroy();
+    task_destroy();
+    task_free_stacks(&old_vm->main_task);
+    input_destroy();
+    compile_destroy();
+    jit_destroy();
+    profile_destroy();
+    dict_destroy();
+    mem_destroy();
+    vm = (saved == old_vm ? NULL : saved);
+
+    free(old_vm);
+}
 
 
 void catch (const pvf *xt) {
@@ -46,14 +129,15 @@ void catch (const pvf *xt) {
         throw(EXC_EXOVER);  /* doesn't return */
     }
 
-    frame->ds_top = data_stack.top;
-    frame->rs_top = return_stack.top;
-    frame->cs_top = control_stack.top;
+    frame->ds_top = vm->task->data_stack.top;
+    frame->rs_top = vm->task->return_stack.top;
+    frame->cs_top = vm->task->control_stack.top;
+    frame->input_depth = input_depth();
 
     if ((exception = setjmp(frame->target)) == 0) {
         fprintf(stderr, "Executing xt %p with exception handler\n", (void*) xt); 
 
-        execute(xt);  /* doesn't return if an exception occurs */
+        execute_checked(xt);  /* doesn't return if an exception occurs */
         exception_drop_frame();
 
         // EXECUTE ran successfully, push a 0
@@ -64,9 +148,10 @@ void catch (const pvf *xt) {
         fprintf (stderr, "Caught exception %i while executing %p\n", exception, xt);
 
         // Reset stacks
-        data_stack.top = frame->ds_top;
-        return_stack.top = frame->rs_top;
-        control_stack.top = frame->cs_top;
+        vm->task->data_stack.top = frame->ds_top;
+        vm->task->return_stack.top = frame->rs_top;
+        vm->task->control_stack.top = frame->cs_top;
+        input_restore(frame->input_depth);
 
         // Push the exception value
         DPUSH((cell)(intptr_t) exception);
@@ -99,53 +184,79 @@ void throw (intptr_t exception) {
 }
 
 
+/*
+  An execution token is valid if it's the code field of an entry in the dictionary.  This
+  is checked by address against the dictionary index, so a wild pointer is rejected without
+  ever being dereferenced.  Debug builds also check the entry's sentinel.
+*/
+void vm_check_xt (const pvf *xt) {
+    if (xt == NULL || !dict_contains(CFA_to_DE(xt))
+#ifdef VM_DEBUG
+        || *CFA_to_SFA(xt) != SENTINEL
+#endif
+    ) {
+        fprintf(stderr, "Invalid execution token: %p\n", (void*) xt);
+        throw(EXC_INV_ADDR);  /* doesn't return */
+    }
+}
+
+
 void do_interpret (void *pfa) {
-    CountedString *word;
+    CountedString word;
+    const char *name;
+    intptr_t len;
     register cell a;
 
-    DPUSH((cell)(intptr_t)' ');
-    _WORD(NULL);
-
-    DPEEK(a);
-    word = a.as_cs;
+    // Look the name up where it lies in the input buffer, rather than copying it out first
+    if ((len = input_parse_name(&name)) < 0) {
+        // End of an included file just returns to whoever included it
+        if (input_depth() > 0)  return;
+        else if (feof(stdin))  exit(0);
+        else  exit(1);
+    }
 
-    _FIND(NULL);
-    DPOP(a); 
+    a.as_de = dict_find(name, len);
     if (a.as_i) {
         // Found the word in the dictionary
         DictEntry *de = a.as_de;
 
-        if (interpreter_state == S_INTERPRET && (de->flags & F_COMPONLY)) {
+        if (vm->interpreter_state == S_INTERPRET && (de->flags & F_COMPONLY)) {
             // Do nothing
             fprintf (stderr, "Useless use of \"%.*s\" in interpret mode\n", 
                 (de->flags & F_LENMASK), de->name);
         }
-        else if (interpreter_state == S_COMPILE && ! (de->flags & F_IMMED)) {
+        else if (vm->interpreter_state == S_COMPILE && ! (de->flags & F_IMMED)) {
             // Compile it
-            DPUSH(a);
-            _DEtoCFA(NULL);
-            _comma(NULL);
+            compile_xt(DE_to_CFA(de));
+        }
+        else if (vm->interpreter_state == S_COMPILE) {
+            // Run it, and don't let what's compiled next be fused with what came before
+            execute(DE_to_CFA(de));
+            compile_barrier();
         }
         else {
             // Run it
-            DPUSH(a);
-            _DEtoCFA(NULL);
-            DPOP(a);
-            execute(a.as_xt); 
+            execute(DE_to_CFA(de));
         }
     }
     else {
         // Word not found - try to parse a literal number out of it
-        DPUSH((cell) word);
+        if (len > MAX_COUNTED_STRING_LENGTH - 1) {
+            throw(EXC_UNDEF);  /* doesn't return */
+        }
+        word.length = len;
+        memcpy(word.value, name, len);
+        word.value[len] = '\0';
+
+        DPUSH((cell)(void *) &word);
         _NUMBER(NULL);
         DPOP(a);  // Grab the return status
         if (a.as_i == 0) {
             // If there were 0 characters remaining, a number was parsed successfully
             // Value is still on the stack
-            if (interpreter_state == S_COMPILE) {
+            if (vm->interpreter_state == S_COMPILE) {
                 // If we're in compile mode, first compile LIT...
-                DPUSH((cell) DE_to_CFA(&_dict__LIT));
-                _comma(NULL);
+                compile_xt(DE_to_CFA(&_dict__LIT));
                 // ... and then compile and eat the value (which is still on the stack)
                 _comma(NULL);
             }
@@ -163,37 +274,521 @@ void do_interpret (void *pfa) {
     *pfa    = parameter field, contains address of code field for next word
     **pfa   = code field, contains address of function to process the word
     ***pfa  = interpreter function for the word 
+
+    The instruction pointer lives in a register for the duration of the definition.  Words
+    whose code field is do_threaded are not called at all: their opcode (stored in their
+    own parameter field) selects a handler below, which is free to move ip itself -- this
+    is how LIT, BRANCH etc consume their inline arguments.  With GCC/Clang each handler
+    dispatches the next word itself via computed goto; otherwise a switch is used.
+
+    The top of the data stack is also kept in a register (tos), while data_stack.top still
+    counts it, so values[top] is stale.  Each handler checks the stack depth once, up front,
+    against its own stack effect.  tos is spilled back to values[top] before anything else
+    can look at the stack: calling out to another word, returning, or throwing.
+
+    Nor are other colon definitions called: ip is pushed onto the return stack and pointed
+    at the callee's body, and EXIT pops it back off again, so nesting costs no C stack and
+    is only limited by the size of the return stack (RSIZE).  Running out of it throws
+    EXC_RS_OVER like any other overflow.  The return addresses pushed by this invocation
+    are the ones above base; an EXIT with none left returns from do_colon itself.  Anything
+    a word leaves on the return stack when it EXITs will be taken for its return address.
+
+    While PROFILE-ON or SAMPLE-ON is in effect, nesting, EXIT, tail calls and calls out to
+    other words are reported to profile.c as well, and profile.where is kept pointing into
+    the word being run, for the sampler.  Whether either is on is kept in a register
+    (profiling), which only a call out can change.
  */
+#if defined(__GNUC__) && !defined(VM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO
+#endif
+
 void do_colon (void *pfa) {
+    register cell *ip = pfa;
+    register pvf *xt;
+    register cell tos;
     register cell a;
-    docolon_mode = DM_NORMAL;
-    cell *param = pfa;
-    for (int i = 0; docolon_mode != DM_NORMAL || param[i].as_xt != 0; i++) {
-        switch (docolon_mode) {
-            case DM_SKIP:
-                /* do nothing */
-                docolon_mode = DM_NORMAL;
-                break;
-            case DM_NORMAL:
-                execute(param[i].as_xt);
-                break;
-            case DM_BRANCH:
-                a = param[i];       // param is an offset to branch to
-                i += (a.as_i - 1);  // nb the for() increment will add the extra 1
-                docolon_mode = DM_NORMAL;
-                break;
-            case DM_LITERAL:
-                DPUSH(param[i]);
-                docolon_mode = DM_NORMAL;
-                break;
-            case DM_SLITERAL:
-                DPUSH((cell)(void*) &param[i+1]);   // start of string
-                a = param[i]; DPUSH(a);             // length
-                i += (CELLALIGN(a.as_i) / sizeof(cell));  
-                docolon_mode = DM_NORMAL;
-                break;
+    Task * const task = vm->task;                 // vm is thread local, so look it up just once
+    Stack * const ds = &task->data_stack;
+    Stack * const rs = &task->return_stack;
+    register cell *rp = &rs->values[rs->top];     // return stack top, likewise
+    cell * const rbase = rp;
+    cell * const rlimit = &rs->values[rs->size - 1];
+    register int profiling = vm->profile.on;    // see profile.c
+#ifdef VM_PROFILE_PAIRS
+    const pvf *prev = NULL;
+#endif
+
+#define TOP             (ds->top)
+#define DS(N)           (ds->values[TOP - (N)])  /* N below tos, N >= 1 */
+#define SPILL()         (ds->values[TOP] = tos)
+#define FILL()          (tos = ds->values[TOP])
+#define RSPILL()        (rs->top = rp - rs->values)
+#define RFILL()         (rp = &rs->values[rs->top])
+#define VM_THROW(E)     do { SPILL(); RSPILL(); throw(E); } while (0)
+#define NEED(N)         do { if (TOP < (N) - 1)  VM_THROW(EXC_DS_UNDER); } while (0)
+#define ROOM(N)         do { if (TOP > ds->size - 1 - (N))  VM_THROW(EXC_DS_OVER); } while (0)
+#define PUSH(X)         do { SPILL(); ++TOP; tos = (X); } while (0)  /* X mustn't use DS() */
+#define DROP(N)         do { TOP -= (N); FILL(); } while (0)
+#define BINARY(EXPR)    do { NEED(2); a = DS(1); tos = (cell)(EXPR); --TOP; } while (0)
+#define UNARY(EXPR)     do { NEED(1); tos = (cell)(EXPR); } while (0)
+#define SAMPLE_POINT()  PROFILE_CHANGING(&task->profile, task->profile.where = ip; RSPILL())
+#ifdef VM_PROFILE_PAIRS
+#define COUNT_PAIR()    do { compile_count_pair(prev, xt); prev = xt; } while (0)
+#else
+#define COUNT_PAIR()    ((void) 0)
+#endif
+
+#ifdef VM_COMPUTED_GOTO
+    static void * const optable[OP_COUNT] = {
+        [OP_LIT]                = &&op_lit,
+        [OP_BRANCH]             = &&op_branch,
+        [OP_0BRANCH]            = &&op_0branch,
+        [OP_LITSTRING]          = &&op_litstring,
+        [OP_DROP]               = &&op_drop,
+        [OP_SWAP]               = &&op_swap,
+        [OP_DUP]                = &&op_dup,
+        [OP_OVER]               = &&op_over,
+        [OP_ROT]                = &&op_rot,
+        [OP_1PLUS]              = &&op_1plus,
+        [OP_1MINUS]             = &&op_1minus,
+        [OP_PLUS]               = &&op_plus,
+        [OP_MINUS]              = &&op_minus,
+        [OP_MULTIPLY]           = &&op_multiply,
+        [OP_EQUALS]             = &&op_equals,
+        [OP_NOTEQUALS]          = &&op_notequals,
+        [OP_LT]                 = &&op_lt,
+        [OP_GT]                 = &&op_gt,
+        [OP_LTE]                = &&op_lte,
+        [OP_GTE]                = &&op_gte,
+        [OP_ZERO_EQUALS]        = &&op_zero_equals,
+        [OP_NOTZERO_EQUALS]     = &&op_notzero_equals,
+        [OP_ZERO_LT]            = &&op_zero_lt,
+        [OP_ZERO_GT]            = &&op_zero_gt,
+        [OP_ZERO_LTE]           = &&op_zero_lte,
+        [OP_ZERO_GTE]           = &&op_zero_gte,
+        [OP_AND]                = &&op_and,
+        [OP_OR]                 = &&op_or,
+        [OP_XOR]                = &&op_xor,
+        [OP_INVERT]             = &&op_invert,
+        [OP_STORE]              = &&op_store,
+        [OP_FETCH]              = &&op_fetch,
+        [OP_ADDSTORE]           = &&op_addstore,
+        [OP_STOREBYTE]          = &&op_storebyte,
+        [OP_FETCHBYTE]          = &&op_fetchbyte,
+        [OP_LTR]                = &&op_ltr,
+        [OP_RGT]                = &&op_rgt,
+        [OP_RAT]                = &&op_rat,
+        [OP_DO]                 = &&op_do,
+        [OP_QDO]                = &&op_qdo,
+        [OP_LOOP]               = &&op_loop,
+        [OP_PLUSLOOP]           = &&op_plusloop,
+        [OP_I]                  = &&op_i,
+        [OP_J]                  = &&op_j,
+        [OP_UNLOOP]             = &&op_unloop,
+        [OP_TAIL]               = &&op_tail,
+        [OP_LIT_PLUS]           = &&op_lit_plus,
+        [OP_DUP_FETCH]          = &&op_dup_fetch,
+        [OP_OVER_OVER]          = &&op_over_over,
+        [OP_ZERO_EQUALS_0BRANCH] = &&op_zero_equals_0branch,
+        [OP_RAT_ZERO_GT]        = &&op_rat_zero_gt,
+    };
+#define OPCASE(OP, LABEL)   LABEL
+#define NEXT                                                            \
+    do {                                                                \
+        xt = (ip++)->as_xt;                                             \
+        if (xt == NULL)  goto exit;                                     \
+        VM_CHECK_XT(xt);                                                \
+        COUNT_PAIR();                                                   \
+        if (*xt == do_threaded)                                         \
+            goto *optable[(CFA_to_DFA(xt))->as_i];                      \
+        goto call;                                                      \
+    } while (0)
+#else
+#define OPCASE(OP, LABEL)   case OP
+#define NEXT                continue
+#endif
+
+    FILL();
+
+    for (;;) {
+        xt = (ip++)->as_xt;
+        if (xt == NULL) {
+#ifdef VM_COMPUTED_GOTO
+    exit:
+#endif
+            if (profiling & PROFILE_TIMING)  profile_exit(rp - rs->values);
+            if (rp <= rbase)  break;  /* EXIT from the word this was called for */
+            ip = (rp--)->as_dfa;
+            if (profiling)  SAMPLE_POINT();
+            NEXT;
+        }
+        VM_CHECK_XT(xt);
+        COUNT_PAIR();
+
+        if (*xt != do_threaded) {
+#ifdef VM_COMPUTED_GOTO
+    call:
+#endif
+            if (*xt == do_colon) {
+                if (rp >= rlimit)  VM_THROW(rs->overflow);
+                (++rp)->as_dfa = ip;
+                ip = CFA_to_DFA(xt);
+                if (profiling) {
+                    if (profiling & PROFILE_TIMING)  profile_enter(xt, rp - rs->values);
+                    SAMPLE_POINT();
+                }
+                NEXT;
+            }
+            SPILL();
+            RSPILL();
+            if (profiling)  profile_call(xt);
+            else  (**xt)(CFA_to_DFA(xt));  /* already checked, if we're checking */
+            FILL();
+            RFILL();
+            profiling = vm->profile.on;
+            continue;
+        }
+
+#ifdef VM_COMPUTED_GOTO
+        goto *optable[(CFA_to_DFA(xt))->as_i];
+        {
+#else
+        switch ((CFA_to_DFA(xt))->as_i) {
+#endif
+            OPCASE(OP_LIT, op_lit):
+                ROOM(1);
+                PUSH(*ip++);
+                NEXT;
+
+            OPCASE(OP_BRANCH, op_branch):
+                ip += ip->as_i;         // param is an offset to branch to
+                NEXT;
+
+            OPCASE(OP_0BRANCH, op_0branch):
+                NEED(1);
+                a = tos;
+                DROP(1);
+                ip += (a.as_i == 0 ? ip->as_i : 1);
+                NEXT;
+
+            OPCASE(OP_LITSTRING, op_litstring):
+                ROOM(2);
+                a = *ip++;                          // length
+                PUSH((cell)(void*) ip);             // start of string
+                PUSH(a);
+                ip += CELLALIGN(a.as_u) / sizeof(cell);
+                NEXT;
+
+            OPCASE(OP_DROP, op_drop):               // ( a -- )
+                NEED(1);
+                DROP(1);
+                NEXT;
+
+            OPCASE(OP_SWAP, op_swap):               // ( b a -- a b )
+                NEED(2);
+                a = DS(1);
+                DS(1) = tos;
+                tos = a;
+                NEXT;
+
+            OPCASE(OP_DUP, op_dup):                 // ( a -- a a )
+                NEED(1);
+                ROOM(1);
+                PUSH(tos);
+                NEXT;
+
+            OPCASE(OP_OVER, op_over):               // ( b a -- b a b )
+                NEED(2);
+                ROOM(1);
+                a = DS(1);
+                PUSH(a);
+                NEXT;
+
+            OPCASE(OP_ROT, op_rot):                 // ( c b a -- a c b )
+                NEED(3);
+                a = DS(1);
+                DS(1) = DS(2);
+                DS(2) = tos;
+                tos = a;
+                NEXT;
+
+            OPCASE(OP_1PLUS, op_1plus):         UNARY(tos.as_i + 1);                NEXT;
+            OPCASE(OP_1MINUS, op_1minus):       UNARY(tos.as_i - 1);                NEXT;
+            OPCASE(OP_PLUS, op_plus):           BINARY(a.as_i + tos.as_i);          NEXT;
+            OPCASE(OP_MINUS, op_minus):         BINARY(a.as_i - tos.as_i);          NEXT;
+            OPCASE(OP_MULTIPLY, op_multiply):   BINARY(a.as_i * tos.as_i);          NEXT;
+            OPCASE(OP_EQUALS, op_equals):       BINARY((intptr_t)(a.as_i == tos.as_i));  NEXT;
+            OPCASE(OP_NOTEQUALS, op_notequals): BINARY((intptr_t)(a.as_i != tos.as_i));  NEXT;
+            OPCASE(OP_LT, op_lt):               BINARY((intptr_t)(a.as_i < tos.as_i));   NEXT;
+            OPCASE(OP_GT, op_gt):               BINARY((intptr_t)(a.as_i > tos.as_i));   NEXT;
+            OPCASE(OP_LTE, op_lte):             BINARY((intptr_t)(a.as_i <= tos.as_i));  NEXT;
+            OPCASE(OP_GTE, op_gte):             BINARY((intptr_t)(a.as_i >= tos.as_i));  NEXT;
+            OPCASE(OP_ZERO_EQUALS, op_zero_equals):         UNARY((intptr_t)(tos.as_i == 0));  NEXT;
+            OPCASE(OP_NOTZERO_EQUALS, op_notzero_equals):   UNARY((intptr_t)(tos.as_i != 0));  NEXT;
+            OPCASE(OP_ZERO_LT, op_zero_lt):     UNARY((intptr_t)(tos.as_i < 0));    NEXT;
+            OPCASE(OP_ZERO_GT, op_zero_gt):     UNARY((intptr_t)(tos.as_i > 0));    NEXT;
+            OPCASE(OP_ZERO_LTE, op_zero_lte):   UNARY((intptr_t)(tos.as_i <= 0));   NEXT;
+            OPCASE(OP_ZERO_GTE, op_zero_gte):   UNARY((intptr_t)(tos.as_i >= 0));   NEXT;
+            OPCASE(OP_AND, op_and):             BINARY(a.as_u & tos.as_u);          NEXT;
+            OPCASE(OP_OR, op_or):               BINARY(a.as_u | tos.as_u);          NEXT;
+            OPCASE(OP_XOR, op_xor):             BINARY(a.as_u ^ tos.as_u);          NEXT;
+            OPCASE(OP_INVERT, op_invert):       UNARY(~tos.as_u);                   NEXT;
+
+            OPCASE(OP_STORE, op_store):             // ( a addr -- )
+                NEED(2);
+                *tos.as_dfa = DS(1);
+                DROP(2);
+                NEXT;
+
+            OPCASE(OP_FETCH, op_fetch):             // ( addr -- a )
+                UNARY(*tos.as_dfa);
+                NEXT;
+
+            OPCASE(OP_ADDSTORE, op_addstore):       // ( delta addr -- )
+                NEED(2);
+                tos.as_dfa->as_i += DS(1).as_i;
+                DROP(2);
+                NEXT;
+
+            OPCASE(OP_STOREBYTE, op_storebyte):     // ( value addr -- )
+                NEED(2);
+                *(char*) tos.as_ptr = (char) DS(1).as_i;
+                DROP(2);
+                NEXT;
+
+            OPCASE(OP_FETCHBYTE, op_fetchbyte):     // ( addr -- value )
+                UNARY((uintptr_t) *(unsigned char*) tos.as_ptr);
+                NEXT;
+
+            OPCASE(OP_LTR, op_ltr):                 // ( a -- ) ( R: -- a )
+                NEED(1);
+                if (rp >= rlimit)  VM_THROW(rs->overflow);
+                *++rp = tos;
+                DROP(1);
+                NEXT;
+
+            OPCASE(OP_RGT, op_rgt):                 // ( -- a ) ( R: a -- )
+                ROOM(1);
+                if (rp <= rs->values - 1)  VM_THROW(rs->underflow);
+                PUSH(*rp--);
+                NEXT;
+
+            OPCASE(OP_RAT, op_rat):                 // ( -- a ) ( R: a -- a )
+                ROOM(1);
+                if (rp <= rs->values - 1)  VM_THROW(rs->underflow);
+                PUSH(*rp);
+                NEXT;
+
+            /* Counted loops: the limit and index are on the return stack, index on top */
+
+            OPCASE(OP_QDO, op_qdo):                 // ( limit start -- ) ( R: -- limit index | )
+                NEED(2);
+                if (DS(1).as_i == tos.as_i) {
+                    DROP(2);
+                    ip += ip->as_i;     // past the end of the loop
+                    NEXT;
+                }
+                ip++;
+                /* fall through */
+
+            OPCASE(OP_DO, op_do):                   // ( limit start -- ) ( R: -- limit index )
+                NEED(2);
+                if (rp >= rlimit - 1)  VM_THROW(rs->overflow);
+                rp[1] = DS(1);
+                rp[2] = tos;
+                rp += 2;
+                DROP(2);
+                NEXT;
+
+            OPCASE(OP_LOOP, op_loop):               // ( -- ) ( R: limit index -- limit index+1 | )
+                if (rp <= rs->values)  VM_THROW(rs->underflow);
+                if (++rp->as_i != rp[-1].as_i) {
+                    ip += ip->as_i;     // back to the start of the loop
+                    NEXT;
+                }
+                rp -= 2;
+                ip++;
+                NEXT;
+
+            OPCASE(OP_PLUSLOOP, op_plusloop):       // ( n -- ) ( R: limit index -- limit index+n | )
+                NEED(1);
+                if (rp <= rs->values)  VM_THROW(rs->underflow);
+                a = tos;
+                DROP(1);
+                {
+                    // Done when index crosses the boundary between limit-1 and limit, in
+                    // either direction: index-limit changes sign, going towards 0 rather
+                    // than wrapping round
+                    uintptr_t before = rp->as_u - rp[-1].as_u;
+                    uintptr_t after = before + a.as_u;
+
+                    rp->as_u += a.as_u;
+                    if ((intptr_t)((before ^ after) & (before ^ a.as_u)) >= 0) {
+                        ip += ip->as_i;
+                        NEXT;
+                    }
+                }
+                rp -= 2;
+                ip++;
+                NEXT;
+
+            OPCASE(OP_I, op_i):                     // ( -- index ) ( R: limit index -- limit index )
+                ROOM(1);
+                if (rp <= rs->values)  VM_THROW(rs->underflow);
+                PUSH(*rp);
+                NEXT;
+
+            OPCASE(OP_J, op_j):                     // ( -- index2 ) ( R: limit2 index2 limit1 index1 -- same )
+                ROOM(1);
+                if (rp <= rs->values + 2)  VM_THROW(rs->underflow);
+                PUSH(rp[-2]);
+                NEXT;
+
+            OPCASE(OP_UNLOOP, op_unloop):           // ( -- ) ( R: limit index -- )
+                if (rp <= rs->values)  VM_THROW(rs->underflow);
+                rp -= 2;
+                NEXT;
+
+            OPCASE(OP_TAIL, op_tail):               // ( -- ) jump into a colon definition
+                xt = ip->as_xt;
+                if (xt == NULL)  NEXT;  /* run directly, see do_threaded */
+                VM_CHECK_XT(xt);
+                if (*xt != do_colon) {
+                    // it's been given native code since (see jit.c): call it, then EXIT
+                    ip++;
+                    SPILL();
+                    RSPILL();
+                    if (profiling)  profile_call(xt);
+                    else  (**xt)(CFA_to_DFA(xt));
+                    FILL();
+                    RFILL();
+                    profiling = vm->profile.on;
+                    NEXT;
+                }
+                ip = CFA_to_DFA(xt);    // returning to our caller, not to us
+                if (profiling) {
+                    if (profiling & PROFILE_TIMING)  profile_tail(xt, rp - rs->values);
+                    SAMPLE_POINT();
+                }
+                NEXT;
+
+            /* Superinstructions, see compile.c */
+
+            OPCASE(OP_LIT_PLUS, op_lit_plus):       // ( a -- a+n )
+                UNARY(tos.as_i + (ip++)->as_i);
+                NEXT;
+
+            OPCASE(OP_DUP_FETCH, op_dup_fetch):     // ( addr -- addr a )
+                NEED(1);
+                ROOM(1);
+                a = *tos.as_dfa;
+                PUSH(a);
+                NEXT;
+
+            OPCASE(OP_OVER_OVER, op_over_over):     // ( b a -- b a b a )
+                NEED(2);
+                ROOM(2);
+                a = DS(1);
+                PUSH(a);
+                a = DS(1);
+                PUSH(a);
+                NEXT;
+
+            OPCASE(OP_ZERO_EQUALS_0BRANCH, op_zero_equals_0branch):    // ( a -- )
+                NEED(1);
+                a = tos;
+                DROP(1);
+                ip += (a.as_i != 0 ? ip->as_i : 1);
+                NEXT;
+
+            OPCASE(OP_RAT_ZERO_GT, op_rat_zero_gt): // ( -- flag ) ( R: a -- a )
+                ROOM(1);
+                if (rp <= rs->values - 1)  VM_THROW(rs->underflow);
+                PUSH((cell)(intptr_t)(rp->as_i > 0));
+                NEXT;
         }
     }
+
+    SPILL();
+    RSPILL();
+
+#undef OPCASE
+#undef NEXT
+#undef TOP
+#undef DS
+#undef SPILL
+#undef FILL
+#undef RSPILL
+#undef RFILL
+#undef VM_THROW
+#undef NEED
+#undef ROOM
+#undef PUSH
+#undef DROP
+#undef BINARY
+#undef UNARY
+#undef SAMPLE_POINT
+#undef COUNT_PAIR
+}
+
+
+/*
+  runs a threaded-code operation that was called directly (by EXECUTE, or from the
+  interpreter) rather than from within a colon definition.  Any inline argument it
+  expects reads as zero, and a zero branch offset lands on the trailing EXIT.
+
+  The ones that push onto the return stack are done here instead: the trailing EXIT would
+  take what they pushed for a return address.
+*/
+void do_threaded (void *pfa) {
+    cell thread[3] = { CELL(DFA_to_CFA(pfa)), CELL(0), CELL(0) };
+    cell a, b;
+
+    switch (((cell *) pfa)->as_i) {
+        case OP_LTR:                // ( a -- ) ( R: -- a )
+            DPOP(a);
+            RPUSH(a);
+            return;
+
+        case OP_QDO:                // ( limit start -- ) ( R: -- limit index | )
+        case OP_DO:                 // ( limit start -- ) ( R: -- limit index )
+            DPOP(b);
+            DPOP(a);
+            if (((cell *) pfa)->as_i == OP_QDO && a.as_i == b.as_i)  return;
+            RPUSH(a);
+            RPUSH(b);
+            return;
+
+        default:
+            do_colon(thread);
+    }
+}
+
+
+/*
+  says what, if anything, follows xt inline when it's compiled into a colon definition
+*/
+InlineArg vm_xt_arg (const pvf *xt) {
+    if (*xt != do_threaded)  return ARG_NONE;
+
+    switch ((CFA_to_DFA(xt))->as_i) {
+        case OP_LIT:
+        case OP_LIT_PLUS:
+            return ARG_LITERAL;
+        case OP_BRANCH:
+        case OP_0BRANCH:
+        case OP_ZERO_EQUALS_0BRANCH:
+        case OP_QDO:
+        case OP_LOOP:
+        case OP_PLUSLOOP:
+            return ARG_BRANCH;
+        case OP_LITSTRING:
+            return ARG_STRING;
+        case OP_TAIL:
+            return ARG_XT;
+        default:
+            return ARG_NONE;
+    }
 }
 
 
@@ -213,6 +808,14 @@ void do_variable (void *pfa) {
     DPUSH((cell) pfa);
 }
 
+/*
+  finds a builtin variable's index in the parameter field and pushes the ADDRESS of this
+  VM's copy of it onto the parameter stack
+*/
+void do_user (void *pfa) {
+    DPUSH((cell)(void *) &vm->user[((cell *) pfa)->as_u]);
+}
+
 /*
   finds a value in the parameter field and pushes its VALUE onto the parameter stack
 */
@@ -220,20 +823,3 @@ void do_value (void *pfa) {
     // pfa is a pointer to the parameter field, so deref it to get the value
     DPUSH(*((cell *) pfa));
 }
-
-
-
-cell getkey() {
-    last_key.as_i = fgetc(stdin);
-    return last_key;
-}
-
-cell lastkey() {
-    return last_key;
-}
-
-void dropline() {
-    register cell c;
-    for (c = lastkey(); c.as_i != EOF && c.as_i != '\n'; c = getkey()) ;
-    if (c.as_i == EOF)  exit(feof(stdin) ? 0 : 1);
-}
@@ -5,65 +5,80 @@
 
 #include "forth.h"
 
-extern jmp_buf abort_jmp;
-extern jmp_buf quit_jmp;
+VM  *vm_new ();
+void vm_free (VM *old_vm);
+int  vm_share ();
+void vm_check_xt (const pvf *xt);
 
+/*
+ * Building with -DVM_DEBUG (make DEBUG=1) validates every execution token before it's run,
+ * including the ones in compiled code.  Otherwise only tokens that come from outside of
+ * the compiler (EXECUTE, CATCH) are validated, via execute_checked().
+ */
+#ifdef VM_DEBUG
+#define VM_CHECK_XT(XT)     vm_check_xt(XT)
+#else
+#define VM_CHECK_XT(XT)     ((void) 0)
+#endif
+
+// Runs a trusted execution token, such as one the compiler itself has written
 static inline void execute (const pvf *xt) {
-    const uint32_t *sentinel = CFA_to_SFA(xt);
-    // FIXME if xt is out of our address range it can sigbus when we compare against SENTINEL
-    if (xt != NULL && sentinel != NULL && *sentinel == SENTINEL) {
-//        This MUST pass an argument -- here we are calling do_colon or whatever, and passing
-//        in a pointer to the actual colon definition to run 
-        (**xt)(CFA_to_DFA(xt));
-    }
-    else {
-        fprintf(stderr, "Invalid execution token: %p\n", xt);
-        throw(EXC_INV_ADDR);
-    }
+    VM_CHECK_XT(xt);
+//  This MUST pass an argument -- here we are calling do_colon or whatever, and passing
+//  in a pointer to the actual colon definition to run 
+    if (vm->profile.on)  profile_call(xt);
+    else  (**xt)(CFA_to_DFA(xt));
+}
+
+// Runs an execution token from an untrusted source; throws EXC_INV_ADDR if it's not valid
+static inline void execute_checked (const pvf *xt) {
+    vm_check_xt(xt);
+    if (vm->profile.on)  profile_call(xt);
+    else  (**xt)(CFA_to_DFA(xt));
 }
 
 static inline void vm_quit() {
     fprintf(stderr, "vm_quit called...\n");
-    longjmp(quit_jmp, 1);
+    longjmp(vm->task->quit_jmp, 1);
 }
 
 static inline void vm_abort() {
     fprintf(stderr, "vm_abort called...\n");
-    longjmp(abort_jmp, -1);
+    longjmp(vm->task->abort_jmp, -1);
 }
 
 void catch (const pvf *);
 void throw (intptr_t exception); 
 void do_interpret (void *);
 void do_colon (void *);
+void do_threaded (void *);
 void do_constant (void *);
 void do_variable (void *);
+void do_user (void *);
 void do_value (void *);
+InlineArg vm_xt_arg (const pvf *xt);
 
-cell getkey();
-cell lastkey();
-void dropline();
 
 // Data stack macros
-#define DPEEK(X)    X = stack_peek(&data_stack)
-#define DPOP(X)     X = stack_pop(&data_stack)
-#define DPUSH(X)    stack_push(&data_stack, (X))
-#define DPICK(X)    stack_pick(&data_stack, (X))
-#define DROLL(X)    stack_roll(&data_stack, (X))
+#define DPEEK(X)    X = stack_peek(&vm->task->data_stack)
+#define DPOP(X)     X = stack_pop(&vm->task->data_stack)
+#define DPUSH(X)    stack_push(&vm->task->data_stack, (X))
+#define DPICK(X)    stack_pick(&vm->task->data_stack, (X))
+#define DROLL(X)    stack_roll(&vm->task->data_stack, (X))
 
 // Return stack macros
-#define RPEEK(X)    X = stack_peek(&return_stack)
-#define RPOP(X)     X = stack_pop(&return_stack)
-#define RPUSH(X)    stack_push(&return_stack, (X))
-#define RPICK(X)    stack_pick(&return_stack, (X))
-#define RROLL(X)    stack_roll(&return_stack, (X))
+#define RPEEK(X)    X = stack_peek(&vm->task->return_stack)
+#define RPOP(X)     X = stack_pop(&vm->task->return_stack)
+#define RPUSH(X)    stack_push(&vm->task->return_stack, (X))
+#define RPICK(X)    stack_pick(&vm->task->return_stack, (X))
+#define RROLL(X)    stack_roll(&vm->task->return_stack, (X))
 
 // Control stack macros
-#define CPEEK(X)    X = stack_peek(&control_stack)
-#define CPOP(X)     X = stack_pop(&control_stack)
-#define CPUSH(X)    stack_push(&control_stack, (X))
-#define CPICK(X)    stack_pick(&control_stack, (X))
-#define CCOLL(X)    stack_roll(&control_stack, (X))
+#define CPEEK(X)    X = stack_peek(&vm->task->control_stack)
+#define CPOP(X)     X = stack_pop(&vm->task->control_stack)
+#define CPUSH(X)    stack_push(&vm->task->control_stack, (X))
+#define CPICK(X)    stack_pick(&vm->task->control_stack, (X))
+#define CCOLL(X)    stack_roll(&vm->task->control_stack, (X))
 
 #define CELLALIGN(X)    (((X) + (sizeof(cell) - 1)) & ~(sizeof(cell) - 1))
 